@@ -26,11 +26,11 @@ if (-not $gpp) {
 if ($IsWindows) {
     $outDll = Join-Path $OutDir "game_logic.dll"
     $outSo = Join-Path $OutDir "game_logic.so"
-    $args = @('-O2', '-shared', '-static-libgcc', '-static-libstdc++', '-o', $outDll, $tmp)
+    $args = @('-O2', '-std=c++17', '-pthread', '-shared', '-static-libgcc', '-static-libstdc++', '-o', $outDll, $tmp)
 }
 else {
     $outSo = Join-Path $OutDir "game_logic.so"
-    $args = @('-O2', '-fPIC', '-shared', '-o', $outSo, $tmp)
+    $args = @('-O2', '-std=c++17', '-pthread', '-fPIC', '-shared', '-o', $outSo, $tmp)
 }
 
 Write-Host "Running: g++ $($args -join ' ')" -ForegroundColor Yellow
@@ -19,11 +19,34 @@ if ! command -v g++ >/dev/null 2>&1; then
   exit 2
 fi
 
+# AI_STATS=1 bash build_native.sh : search statistics for get_ai_stats.
+FLAGS=""
+if [ "${AI_STATS:-0}" = "1" ]; then
+  FLAGS="-DAI_STATS"
+fi
+
 OUT="$OUTDIR/game_logic.so"
 echo "Compiling to $OUT"
-g++ -O2 -fPIC -shared -o "$OUT" "$TMP"
+g++ -O2 -std=c++17 -pthread -fPIC -shared $FLAGS -o "$OUT" "$TMP"
 
 echo "Build succeeded: $OUT"
 rm -f "$TMP"
 
+# bash build_native.sh bench : also builds the microbenchmarks.
+if [ "${1:-}" = "bench" ]; then
+  BENCH="$OUTDIR/bench/micro_bench"
+  echo "Compiling $BENCH"
+  g++ -O2 -std=c++17 -pthread $FLAGS -o "$BENCH" "$OUTDIR/bench/micro_bench.cpp"
+  echo "Build succeeded: $BENCH (run: $BENCH --json=bench.json)"
+fi
+
+# bash build_native.sh server : also builds the epoll server, linked against
+# the game_logic.so built above (found next to the binary at run time).
+if [ "${1:-}" = "server" ]; then
+  SERVER="$OUTDIR/server"
+  echo "Compiling $SERVER"
+  g++ -O2 -std=c++17 -pthread -o "$SERVER" "$OUTDIR/server.cpp" -L"$OUTDIR" -l:game_logic.so -Wl,-rpath,'$ORIGIN'
+  echo "Build succeeded: $SERVER"
+fi
+
 exit 0
@@ -1,8 +1,11 @@
 # import eventlet
 # eventlet.monkey_patch()
 
+import atexit
 import ctypes
+import hashlib
 import os
+import threading
 from flask import Flask, request
 from flask_socketio import SocketIO, emit, join_room, leave_room
 from flask_cors import CORS
@@ -31,93 +34,286 @@ lib_loaded = False
 print(f"DEBUG: Looking for native libs at {so_path} and {dll_path}")
 game_lib = ctypes.CDLL(so_path)
 
-# void init_game(int room_id)
-game_lib.init_game.argtypes = [ctypes.c_int]
+# void init_game(long long room_id)  -- creates the room on first use
+game_lib.init_game.argtypes = [ctypes.c_longlong]
 
-# void move_player(int room_id, int player_id, int dx, int dy, int* out_r, int* out_c)
-game_lib.move_player.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int, 
+# int destroy_room(long long room_id)
+game_lib.destroy_room.argtypes = [ctypes.c_longlong]
+game_lib.destroy_room.restype = ctypes.c_int
+
+# void move_player(long long room_id, int player_id, int dx, int dy, int* out_r, int* out_c)
+game_lib.move_player.argtypes = [ctypes.c_longlong, ctypes.c_int, ctypes.c_int, ctypes.c_int, 
                                  ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
 
-# bool place_stone(int room_id, int r, int c, int color)
-game_lib.place_stone.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+# int get_state_since(long long room_id, long long since, int* p_buf, int* p_count,
+#                     int* s_buf, int* s_count, long long* out_version)
+#   1 full snapshot, 0 delta since `since`; removed players come back as (id, -1, -1)
+game_lib.get_state_since.argtypes = [ctypes.c_longlong, ctypes.c_longlong,
+                                     ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
+                                     ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
+                                     ctypes.POINTER(ctypes.c_longlong)]
+game_lib.get_state_since.restype = ctypes.c_int
+
+# int get_state_frame(long long room_id, long long since, unsigned char* buf, int cap,
+#                     long long* out_version)  -- get_state_since packed for the wire
+game_lib.get_state_frame.argtypes = [ctypes.c_longlong, ctypes.c_longlong, ctypes.c_char_p, ctypes.c_int,
+                                     ctypes.POINTER(ctypes.c_longlong)]
+game_lib.get_state_frame.restype = ctypes.c_int
+
+# void set_tick_hz(int hz)  -- cursor updates are batched per room at this rate
+game_lib.set_tick_hz.argtypes = [ctypes.c_int]
+game_lib.set_tick_hz(int(os.environ.get('DASHBLOCKS_TICK_HZ', '30')))
+
+# int next_tick(long long* out_ids, int cap)  -- waits a tick, returns dirty room ids
+game_lib.next_tick.argtypes = [ctypes.POINTER(ctypes.c_longlong), ctypes.c_int]
+game_lib.next_tick.restype = ctypes.c_int
+
+# int remove_player(long long room_id, int player_id)
+game_lib.remove_player.argtypes = [ctypes.c_longlong, ctypes.c_int]
+game_lib.remove_player.restype = ctypes.c_int
+
+# void set_player_capacity(int n)  -- players per room, for rooms created later
+ROOM_PLAYER_CAPACITY = int(os.environ.get('DASHBLOCKS_ROOM_PLAYERS', '50'))
+game_lib.set_player_capacity.argtypes = [ctypes.c_int]
+game_lib.set_player_capacity(ROOM_PLAYER_CAPACITY)
+
+# bool place_stone(long long room_id, int r, int c, int color)
+game_lib.place_stone.argtypes = [ctypes.c_longlong, ctypes.c_int, ctypes.c_int, ctypes.c_int]
 game_lib.place_stone.restype = ctypes.c_bool
 
-# void reset_game(int room_id)
-game_lib.reset_game.argtypes = [ctypes.c_int]
+# void reset_game(long long room_id)
+game_lib.reset_game.argtypes = [ctypes.c_longlong]
+
+# int set_room_shards(int n)  -- native threads that own rooms and apply their commands
+game_lib.set_room_shards.argtypes = [ctypes.c_int]
+game_lib.set_room_shards.restype = ctypes.c_int
+game_lib.set_room_shards(int(os.environ.get('DASHBLOCKS_ROOM_SHARDS', str(os.cpu_count() or 1))))
 
-# void get_state(int room_id, int* p_buf, int* p_count, int* s_buf, int* s_count)
-game_lib.get_state.argtypes = [ctypes.c_int, 
+# int submit_room_command(long long room_id, int kind, int player_id, int a, int b, int color)
+#   -- queued on the room's shard (1) or dropped because the shard is full (0);
+#   the result reaches clients through the tick loop.
+game_lib.submit_room_command.argtypes = [ctypes.c_longlong, ctypes.c_int, ctypes.c_int,
+                                         ctypes.c_int, ctypes.c_int, ctypes.c_int]
+game_lib.submit_room_command.restype = ctypes.c_int
+ROOM_CMD_MOVE, ROOM_CMD_PLACE, ROOM_CMD_RESET, ROOM_CMD_REMOVE = 0, 1, 2, 3
+
+# void get_state(long long room_id, int* p_buf, int* p_count, int* s_buf, int* s_count)
+game_lib.get_state.argtypes = [ctypes.c_longlong, 
                                ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
                                ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
 
-# void get_ai_move(int room_id, int color, int* out_r, int* out_c)
-game_lib.get_ai_move.argtypes = [ctypes.c_int, ctypes.c_int, 
+# void get_ai_move(long long room_id, int color, int* out_r, int* out_c)
+game_lib.get_ai_move.argtypes = [ctypes.c_longlong, ctypes.c_int, 
                                  ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
 
+# void set_tt_size_mb(int mb)  -- per-room AI transposition table budget, 0 disables
+game_lib.set_tt_size_mb.argtypes = [ctypes.c_int]
+game_lib.set_tt_size_mb(int(os.environ.get('DASHBLOCKS_TT_MB', '4')))
+
+# void set_ai_threads(int n)  -- search threads per AI move (Lazy SMP)
+game_lib.set_ai_threads.argtypes = [ctypes.c_int]
+game_lib.set_ai_threads(int(os.environ.get('DASHBLOCKS_AI_THREADS', '1')))
+
+# long long ai_begin(long long room_id, int color, int budget_us)  -- ticket, -1 if busy
+game_lib.ai_begin.argtypes = [ctypes.c_longlong, ctypes.c_int, ctypes.c_int]
+game_lib.ai_begin.restype = ctypes.c_longlong
+
+# int ai_poll(long long ticket, int* out_r, int* out_c, int* out_depth, long long* out_nodes)
+#   0 pending, 1 done, 2 cancelled, -1 unknown ticket
+game_lib.ai_poll.argtypes = [ctypes.c_longlong,
+                             ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int),
+                             ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_longlong)]
+
+# void ai_cancel(long long ticket)
+game_lib.ai_cancel.argtypes = [ctypes.c_longlong]
+
+# void set_ai_workers(int n)  -- native threads running queued AI searches
+game_lib.set_ai_workers.argtypes = [ctypes.c_int]
+game_lib.set_ai_workers(int(os.environ.get('DASHBLOCKS_AI_WORKERS', '2')))
+
+# void ai_ponder(long long room_id, int ai_color)  -- think on the opponent's time
+game_lib.ai_ponder.argtypes = [ctypes.c_longlong, ctypes.c_int]
+
+# void set_ai_ponder(int on)
+game_lib.set_ai_ponder.argtypes = [ctypes.c_int]
+game_lib.set_ai_ponder(int(os.environ.get('DASHBLOCKS_AI_PONDER', '1')))
+
+# int get_ai_stats(long long room_id, AiStats* out)  -- last search of the room:
+#   1 filled in, 0 none yet, -1 library built without AI_STATS (AI_STATS=1 bash build_native.sh)
+# int get_ai_latency_histogram(long long* out, int cap)  -- searches per [2^i, 2^(i+1)) us bucket
+AI_PHASES = ['win', 'block', 'book', 'only', 'threat', 'negamax']
+
+class AiStats(ctypes.Structure):
+    _fields_ = [('nodes', ctypes.c_longlong), ('threat_nodes', ctypes.c_longlong),
+                ('tt_probes', ctypes.c_longlong), ('tt_hits', ctypes.c_longlong),
+                ('cutoffs', ctypes.c_longlong), ('phase_us', ctypes.c_longlong * len(AI_PHASES)),
+                ('total_us', ctypes.c_longlong), ('phase', ctypes.c_int), ('depth', ctypes.c_int),
+                ('threads', ctypes.c_int), ('pv_len', ctypes.c_int), ('pv', ctypes.c_int * 16)]
+
+game_lib.get_ai_stats.argtypes = [ctypes.c_longlong, ctypes.POINTER(AiStats)]
+game_lib.get_ai_stats.restype = ctypes.c_int
+game_lib.get_ai_latency_histogram.argtypes = [ctypes.POINTER(ctypes.c_longlong), ctypes.c_int]
+game_lib.get_ai_latency_histogram.restype = ctypes.c_int
+AI_STATS_LOG = os.environ.get('DASHBLOCKS_AI_STATS_LOG', '0') == '1'
+
+def log_ai_stats(room_id):
+    st = AiStats()
+    if game_lib.get_ai_stats(room_id, ctypes.byref(st)) != 1:
+        return
+    pv = ' '.join(f"{m // BOARD_SIZE},{m % BOARD_SIZE}" for m in st.pv[:st.pv_len])
+    print(f"AI {AI_PHASES[st.phase]} depth {st.depth} nodes {st.nodes} in {st.total_us / 1000:.1f} ms, "
+          f"tt {st.tt_hits}/{st.tt_probes}, cutoffs {st.cutoffs}, pv {pv}")
+
+# int load_opening_book(const char* path)  -- mmap'd book from tools/book_gen.cpp
+game_lib.load_opening_book.argtypes = [ctypes.c_char_p]
+game_lib.load_opening_book.restype = ctypes.c_int
+BOOK_PATH = os.environ.get('DASHBLOCKS_BOOK', os.path.join(os.path.dirname(__file__), 'opening.book'))
+if os.path.exists(BOOK_PATH):
+    print("Opening book entries:", game_lib.load_opening_book(BOOK_PATH.encode()))
+
+# int open_journal(const char* dir)  -- restores saved rooms, then journals every change
+# void set_journal_sync_ms(int ms), void set_journal_snapshot_sec(int sec), void sync_journal()
+game_lib.open_journal.argtypes = [ctypes.c_char_p]
+game_lib.open_journal.restype = ctypes.c_int
+game_lib.set_journal_sync_ms.argtypes = [ctypes.c_int]
+game_lib.set_journal_snapshot_sec.argtypes = [ctypes.c_int]
+JOURNAL_DIR = os.environ.get('DASHBLOCKS_JOURNAL_DIR', '')
+if JOURNAL_DIR:
+    game_lib.set_journal_sync_ms(int(os.environ.get('DASHBLOCKS_JOURNAL_SYNC_MS', '10')))
+    game_lib.set_journal_snapshot_sec(int(os.environ.get('DASHBLOCKS_JOURNAL_SNAPSHOT_SEC', '60')))
+    print("Restored rooms:", game_lib.open_journal(JOURNAL_DIR.encode()))
+    atexit.register(game_lib.sync_journal)
+
+AI_POLL_PENDING, AI_POLL_DONE = 0, 1
+AI_POLL_INTERVAL = 0.01
+
+# Per-move AI search budget (milliseconds)
+AI_BUDGET_US = int(float(os.environ.get('DASHBLOCKS_AI_BUDGET_MS', '300')) * 1000)
+
 BOARD_SIZE = 15
+MAX_STONES = 256
 rooms = {} # pw -> list of sids
 
 def get_room_id(pw):
-    return abs(hash(pw)) % 10000
+    # Stable across restarts (unlike hash()), so journaled rooms are found again.
+    digest = hashlib.blake2b(pw.encode(), digest_size=8).digest()
+    return int.from_bytes(digest, 'little') & 0x7FFFFFFFFFFFFFFF
+
+def drop_stale_players(room_id):
+    # A room restored from the journal still holds the cursors of clients
+    # from before the restart; nobody is connected as them any more.
+    p_buf = (ctypes.c_int * (ROOM_PLAYER_CAPACITY * 3))()
+    s_buf = (ctypes.c_int * (MAX_STONES * 3 + 1))()
+    p_count, s_count = ctypes.c_int(), ctypes.c_int()
+    game_lib.get_state(room_id, p_buf, ctypes.byref(p_count), s_buf, ctypes.byref(s_count))
+    for i in range(p_count.value):
+        game_lib.remove_player(room_id, p_buf[i * 3])
+
+# --- Background AI ---------------------------------------------------------
+# Searches run on native workers; one poller places finished moves.
+ai_jobs = {} # pw -> (ticket, room_id, ai_color)
+ai_jobs_lock = threading.Lock()
+ai_poller_started = False
+
+def cancel_ai(pw):
+    with ai_jobs_lock:
+        job = ai_jobs.pop(pw, None)
+    if job:
+        game_lib.ai_cancel(job[0])
+
+def poll_ai_jobs():
+    ar, ac = ctypes.c_int(0), ctypes.c_int(0)
+    depth, nodes = ctypes.c_int(0), ctypes.c_longlong(0)
+    while True:
+        socketio.sleep(AI_POLL_INTERVAL)
+        with ai_jobs_lock:
+            jobs = list(ai_jobs.items())
+        for pw, (ticket, room_id, ai_color) in jobs:
+            status = game_lib.ai_poll(ticket, ctypes.byref(ar), ctypes.byref(ac),
+                                      ctypes.byref(depth), ctypes.byref(nodes))
+            if status == AI_POLL_PENDING:
+                continue
+            with ai_jobs_lock:
+                if ai_jobs.get(pw, (None,))[0] != ticket:
+                    continue # cancelled meanwhile
+                del ai_jobs[pw]
+            if status == AI_POLL_DONE and AI_STATS_LOG:
+                log_ai_stats(room_id)
+            if status == AI_POLL_DONE and pw in rooms:
+                if game_lib.place_stone(room_id, ar.value, ac.value, ai_color):
+                    game_lib.ai_ponder(room_id, ai_color)
+                    broadcast_room(pw)
+
+def start_ai_poller():
+    global ai_poller_started
+    with ai_jobs_lock:
+        if ai_poller_started:
+            return
+        ai_poller_started = True
+    socketio.start_background_task(poll_ai_jobs)
 
 def get_player_id(sid):
     return abs(hash(sid)) % 10000
 
-def broadcast_room(pw):
-    room_id = get_room_id(pw)
-    p_buf = (ctypes.c_int * 300)() 
-    s_buf = (ctypes.c_int * 768)()
-    p_count = ctypes.c_int(0)
-    s_count = ctypes.c_int(0)
-
-    game_lib.get_state(room_id, p_buf, ctypes.byref(p_count), s_buf, ctypes.byref(s_count))
-
-    count = p_count.value
-    room_data = {}
+# --- Room state broadcast ------------------------------------------------
+# Room state goes out as binary 'room_frame' events packed by the native lib
+# (full snapshots on join or resync, deltas otherwise) and is forwarded
+# untouched. 'room_members' tells clients which player id each member has.
+# room_versions holds the last version broadcast per room.
+room_versions = {} # pw -> version
+broadcast_lock = threading.Lock()
+FRAME_CAP = 64 + ROOM_PLAYER_CAPACITY * 7 + MAX_STONES * 2
+
+def state_frame(room_id, since):
+    buf = ctypes.create_string_buffer(FRAME_CAP)
+    version = ctypes.c_longlong(0)
+    n = game_lib.get_state_frame(room_id, since, buf, FRAME_CAP, ctypes.byref(version))
+    return buf.raw[:max(n, 0)], version.value
+
+def members_payload(pw):
     members = rooms.get(pw, [])
-    
-    c_players = {}
-    for i in range(count):
-        pid = p_buf[i*3]
-        r = p_buf[i*3+1]
-        c = p_buf[i*3+2]
-        c_players[pid] = [r, c]
-        
-    for m in members:
-        pid = get_player_id(m)
-        if pid in c_players:
-            room_data[m] = [c_players[pid]]
-
-    board_state = []
-    sc = s_count.value
-    for i in range(sc):
-        r = s_buf[i*3]
-        c = s_buf[i*3+1]
-        color_val = s_buf[i*3+2]
-        color = 'black' if color_val == 1 else 'white'
-        board_state.append({'r': r, 'c': c, 'color': color})
-
-    # If the native lib appended can_place_color after stones buffer, read it.
-    can_place_color_val = None
-    try:
-        raw_idx = sc * 3
-        if raw_idx < len(s_buf):
-            v = int(s_buf[raw_idx])
-            if v in (1, 2):
-                can_place_color_val = v
-    except Exception:
-        can_place_color_val = None
+    return {'members': members, 'ids': {m: get_player_id(m) for m in members}}
 
-    room_name = f"room:{pw}"
-    payload = {
-        'members': members,
-        'data': room_data,
-        'board': board_state
-    }
-    if can_place_color_val is not None:
-        payload['can_place_color'] = can_place_color_val
+def broadcast_members(pw):
+    socketio.emit('room_members', members_payload(pw), room=f"room:{pw}")
 
-    socketio.emit('room_state', payload, room=room_name)
+def broadcast_room(pw):
+    room_id = get_room_id(pw)
+    with broadcast_lock:
+        since = room_versions.get(pw, -1)
+        frame, version = state_frame(room_id, since)
+        if version == since:
+            return # nothing new since the last broadcast
+        room_versions[pw] = version
+        socketio.emit('room_frame', frame, room=f"room:{pw}")
+
+# Cursor moves are not broadcast one by one: the native tick collects the
+# rooms that changed and each gets one merged frame per tick.
+TICK_BATCH = 1024
+room_pws = {} # room_id -> pw
+ticker_started = False
+
+def tick_loop():
+    ids = (ctypes.c_longlong * TICK_BATCH)()
+    while True:
+        n = game_lib.next_tick(ids, TICK_BATCH)
+        for i in range(n):
+            pw = room_pws.get(ids[i])
+            if pw in rooms:
+                broadcast_room(pw)
+
+def start_ticker():
+    global ticker_started
+    with broadcast_lock:
+        if ticker_started:
+            return
+        ticker_started = True
+    socketio.start_background_task(tick_loop)
+
+def send_full_state(pw, sid):
+    frame, _ = state_frame(get_room_id(pw), -1)
+    socketio.emit('room_members', members_payload(pw), room=sid)
+    socketio.emit('room_frame', frame, room=sid)
 
 @socketio.on('connect')
 def handle_connect():
@@ -130,8 +326,15 @@ def handle_disconnect():
     for pw, members in rooms.items():
         if sid in members:
             members.remove(sid)
-            broadcast_room(pw)
+            game_lib.submit_room_command(get_room_id(pw), ROOM_CMD_REMOVE, get_player_id(sid), 0, 0, 0)
+            broadcast_members(pw)
             if not members:
+                cancel_ai(pw)
+                # Commands still queued for it are dropped, even if the
+                # password brings a new room up under the same id.
+                game_lib.destroy_room(get_room_id(pw))
+                room_versions.pop(pw, None)
+                room_pws.pop(get_room_id(pw), None)
                 del rooms[pw]
             break
 
@@ -143,7 +346,11 @@ def handle_join(evt_data):
     pid = get_player_id(sid)
 
     game_lib.init_game(room_id)
-    
+    if JOURNAL_DIR and pw not in rooms:
+        drop_stale_players(room_id)
+    room_pws[room_id] = pw
+    start_ticker()
+
     members = rooms.setdefault(pw, [])
     if sid not in members:
         members.append(sid)
@@ -153,7 +360,17 @@ def handle_join(evt_data):
     game_lib.move_player(room_id, pid, 0, 0, ctypes.byref(r), ctypes.byref(c))
 
     emit('joined', {'room': pw, 'id': sid})
+    broadcast_members(pw)
     broadcast_room(pw)
+    send_full_state(pw, sid)
+
+@socketio.on('sync')
+def handle_sync():
+    sid = request.sid
+    for pw, members in rooms.items():
+        if sid in members:
+            send_full_state(pw, sid)
+            break
 
 @socketio.on('move')
 def handle_move(evt_data):
@@ -170,10 +387,8 @@ def handle_move(evt_data):
     dx = int(evt_data.get('dx', 0))
     dy = int(evt_data.get('dy', 0))
 
-    out_r = ctypes.c_int()
-    out_c = ctypes.c_int()
-    game_lib.move_player(room_id, pid, dx, dy, ctypes.byref(out_r), ctypes.byref(out_c))
-    broadcast_room(pw)
+    game_lib.submit_room_command(room_id, ROOM_CMD_MOVE, pid, dx, dy, 0)
+    # Broadcast by the next tick (tick_loop), merged with other moves.
 
 @socketio.on('place_stone')
 def handle_place_stone(evt_data=None):
@@ -205,14 +420,11 @@ def handle_place_stone(evt_data=None):
     except Exception:
         r_val = None
 
-    if r_val is None or c_val is None:
-        r, c = ctypes.c_int(0), ctypes.c_int(0)
-        game_lib.move_player(room_id, pid, 0, 0, ctypes.byref(r), ctypes.byref(c))
-        r_val, c_val = r.value, c.value
+    if r_val is None or c_val is None or r_val < 0:
+        r_val, c_val = -1, 0 # the shard places at the player's cursor
 
-    success = game_lib.place_stone(room_id, int(r_val), int(c_val), color)
-    if success:
-        broadcast_room(pw)
+    # A placed stone makes the next tick come right away (tick_loop).
+    game_lib.submit_room_command(room_id, ROOM_CMD_PLACE, pid, int(r_val), int(c_val), color)
 
 @socketio.on('reset')
 def handle_reset():
@@ -225,8 +437,8 @@ def handle_reset():
     if not pw: return
 
     room_id = get_room_id(pw)
-    game_lib.reset_game(room_id)
-    broadcast_room(pw)
+    cancel_ai(pw)
+    game_lib.submit_room_command(room_id, ROOM_CMD_RESET, 0, 0, 0, 0)
 
 @socketio.on('ai_move')
 def handle_ai_move():
@@ -248,12 +460,17 @@ def handle_ai_move():
     my_color = 1 if members.index(sid) == 0 else 2
     ai_color = 1 if my_color == 2 else 2 # AI is opposite of the one who requested it
 
-    ar, ac = ctypes.c_int(0), ctypes.c_int(0)
-    game_lib.get_ai_move(room_id, ai_color, ctypes.byref(ar), ctypes.byref(ac))
-    
-    success = game_lib.place_stone(room_id, ar.value, ac.value, ai_color)
-    if success:
-        broadcast_room(pw)
+    # Queue the search and return; poll_ai_jobs places the move when it lands.
+    # ai_begin waits for the room's queued commands (a PLACE just sent), so
+    # the search starts from the board the players see.
+    with ai_jobs_lock:
+        if pw in ai_jobs:
+            return # already thinking for this room
+        ticket = game_lib.ai_begin(room_id, ai_color, AI_BUDGET_US)
+        if ticket < 0:
+            return
+        ai_jobs[pw] = (ticket, room_id, ai_color)
+    start_ai_poller()
 
 if __name__ == '__main__':
     socketio.run(app, host='0.0.0.0', port=5000)
@@ -0,0 +1,113 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread ai_bench.cpp -o ai_bench
+// 실행 : ./ai_bench [budget_ms] [max_threads] [max_depth]
+//
+// 1. Lazy SMP scaling: nodes per second of get_ai_move_timed on fixed
+//    mid-game positions for 1, 2, 4, ... threads.
+// 2. Move ordering: nodes and time to finish fixed-depth negamax on the
+//    same positions with ordering off (hash move only) and on.
+#include "../game_logic.cpp"
+#include <cstdio>
+
+#define BENCH_ROOM 0
+
+// Deterministic positions: the engine plays itself at fixed depth from the
+// centre and the position after `plies` stones is kept.
+static void setup_position(int plies)
+{
+    init_game(BENCH_ROOM);
+    reset_game(BENCH_ROOM);
+    int color = 1;
+    for (int i = 0; i < plies; i++)
+    {
+        int r, c;
+        get_ai_move(BENCH_ROOM, color, &r, &c);
+        if (!place_stone(BENCH_ROOM, r, c, color))
+            break;
+        color = color == 1 ? 2 : 1;
+    }
+}
+
+static const int plies[] = {8, 14, 20};
+
+// Iterative deepening to `depth` on a fresh table; returns the node count.
+static uint64_t search_to_depth(int depth, int64_t &elapsed)
+{
+    static TransTable tt;
+    if (!tt.buckets)
+        tt.resize(tt_budget_bytes);
+    tt.clear();
+    AI_Board b;
+    GameRoom *room = room_registry.find(BENCH_ROOM);
+    b.from_room(room);
+    b.turn = room->can_place_color == 1 ? 1 : -1;
+    b.tt = &tt;
+    int64_t t0 = now_us();
+    int best = -1, val;
+    for (int d = 1; d <= depth; d++)
+        best = b.search_root(d, best, val);
+    elapsed += now_us() - t0;
+    return b.nodes;
+}
+
+static void bench_ordering(int max_depth)
+{
+    printf("\n%-6s %14s %14s %8s %10s %10s\n", "depth", "nodes(off)", "nodes(on)", "ratio", "ms(off)", "ms(on)");
+    for (int depth = 2; depth <= max_depth; depth++)
+    {
+        uint64_t nodes[2] = {0, 0};
+        int64_t elapsed[2] = {0, 0};
+        for (int p : plies)
+        {
+            setup_position(p);
+            for (int on = 0; on < 2; on++)
+            {
+                ai_move_ordering = on;
+                nodes[on] += search_to_depth(depth, elapsed[on]);
+            }
+        }
+        ai_move_ordering = true;
+        printf("%-6d %14llu %14llu %7.2fx %10.1f %10.1f\n", depth, (unsigned long long)nodes[0],
+               (unsigned long long)nodes[1], (double)nodes[0] / std::max<uint64_t>(nodes[1], 1),
+               elapsed[0] / 1000.0, elapsed[1] / 1000.0);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int budget_ms = argc > 1 ? atoi(argv[1]) : 500;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8;
+    int max_depth = argc > 3 ? atoi(argv[3]) : 4;
+
+    printf("%-8s %14s %10s %10s\n", "threads", "nodes/s", "speedup", "avg depth");
+    double base = 0;
+    for (int t = 1; t <= max_threads; t *= 2)
+    {
+        set_ai_threads(t);
+        long long nodes = 0;
+        int64_t elapsed = 0;
+        int depth_sum = 0;
+        for (int p : plies)
+        {
+            setup_position(p);
+            GameRoom *room = room_registry.find(BENCH_ROOM);
+            if (room->tt)
+                room->tt->clear();
+            int color = room->can_place_color;
+            int r, c, depth;
+            long long n;
+            int64_t t0 = now_us();
+            get_ai_move_timed(BENCH_ROOM, color, budget_ms * 1000, &r, &c, &depth, &n);
+            elapsed += now_us() - t0;
+            nodes += n;
+            depth_sum += depth;
+        }
+        double nps = nodes * 1e6 / (double)std::max<int64_t>(elapsed, 1);
+        if (t == 1)
+            base = nps;
+        printf("%-8d %14.0f %9.2fx %10.1f\n", t, nps, nps / base, depth_sum / 3.0);
+    }
+    set_ai_threads(1);
+
+    bench_ordering(max_depth);
+    return 0;
+}
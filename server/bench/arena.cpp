@@ -0,0 +1,294 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread arena.cpp -o arena
+// 실행 : ./arena [engine_a] [engine_b] [openings] [threads]
+//
+// Self-play arena for catching strength and speed regressions. Engine A
+// (the candidate) plays engine B (the baseline) from a set of opening
+// positions, each opening twice with colours swapped, games running in
+// parallel. Reports A's score with a 95% confidence interval and the Elo
+// difference it implies, plus nodes per second and p50/p99 move latency per
+// engine. Exits with 1 when A is significantly weaker than B.
+//
+// Engines:
+//   native[:budget_ms[:max_depth[:tt_mb]]]   AI_Board (game_logic.cpp), one
+//       search thread. budget_ms 0 searches to max_depth without a clock,
+//       like get_ai_move (depth 3 by default).
+//   legacy                                   Board (ai/gomoku_ai.cpp)
+//
+// Openings: the centre stone, a second stone next to it and a third within
+// two cells, one per symmetry class.
+#include "../game_logic.cpp"
+#include <bits/stdc++.h>
+
+// gomoku_ai.cpp is a standalone program with its own INF and main. Its main
+// falls off the end, which is fine for main but warns once renamed.
+#undef INF
+namespace legacy
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wreturn-type"
+#define main legacy_main
+#include "../ai/gomoku_ai.cpp"
+#undef main
+#pragma GCC diagnostic pop
+}
+
+#define ARENA_MAX_PLIES CELLS
+
+enum EngineKind
+{
+    ENGINE_NATIVE,
+    ENGINE_LEGACY
+};
+
+struct EngineSpec
+{
+    std::string name;
+    int kind = ENGINE_NATIVE;
+    int budget_ms = 100;
+    int max_depth = AI_MAX_DEPTH;
+    int tt_mb = 4;
+};
+
+struct EngineStats
+{
+    std::vector<int> latency_us;
+    uint64_t nodes = 0;
+    int64_t search_us = 0;
+    int max_depth = 0;
+};
+
+struct ArenaTotals
+{
+    std::mutex mutex;
+    int a_wins = 0, b_wins = 0, draws = 0;
+    EngineStats stats[2];
+};
+
+static bool parse_engine(const char *text, EngineSpec &spec)
+{
+    spec.name = text;
+    if (strcmp(text, "legacy") == 0)
+    {
+        spec.kind = ENGINE_LEGACY;
+        return true;
+    }
+    if (strncmp(text, "native", 6) != 0)
+        return false;
+    int v[3] = {spec.budget_ms, -1, spec.tt_mb};
+    const char *p = text + 6;
+    for (int i = 0; i < 3 && *p == ':'; i++)
+        v[i] = (int)strtol(p + 1, (char **)&p, 10);
+    if (*p)
+        return false;
+    spec.budget_ms = std::max(0, v[0]);
+    spec.max_depth = v[1] > 0 ? std::min(v[1], AI_MAX_DEPTH) : (spec.budget_ms ? AI_MAX_DEPTH : 3);
+    spec.tt_mb = std::max(0, v[2]);
+    return true;
+}
+
+// One engine's side of a game: its own table, or the legacy board.
+struct ArenaPlayer
+{
+    const EngineSpec *spec;
+    TransTable tt;
+    legacy::Board old;
+
+    void start()
+    {
+        if (spec->kind == ENGINE_NATIVE && spec->tt_mb > 0)
+        {
+            if (!tt.buckets)
+                tt.resize((size_t)spec->tt_mb << 20);
+            tt.clear();
+        }
+        old = legacy::Board();
+    }
+
+    void played(int m, int p)
+    {
+        old.g[m / BOARD_SIZE][m % BOARD_SIZE] = p;
+    }
+
+    int choose(const AI_Board &pos, int p, EngineStats &st)
+    {
+        int64_t t0 = now_us();
+        int m;
+        if (spec->kind == ENGINE_LEGACY)
+        {
+            old.turn = p;
+            m = legacy::choose_move(old);
+        }
+        else
+        {
+            AI_Board b;
+            b.clear();
+            b.copy_position(pos);
+            b.turn = p;
+            b.threads = 1;
+            b.tt = spec->tt_mb > 0 ? &tt : nullptr;
+            if (b.tt)
+                tt.new_search();
+            int depth;
+            if (spec->budget_ms > 0)
+            {
+                b.deadline_us = now_us() + (int64_t)spec->budget_ms * 1000;
+                m = b.choose_move(1, spec->max_depth, depth);
+            }
+            else
+                m = b.choose_move(spec->max_depth, spec->max_depth, depth);
+            st.nodes += b.nodes;
+            st.max_depth = std::max(st.max_depth, depth);
+        }
+        int64_t dt = now_us() - t0;
+        st.search_us += dt;
+        st.latency_us.push_back((int)dt);
+        return m;
+    }
+};
+
+// Every three-stone opening around the centre, one per symmetry class.
+static std::vector<std::array<int, 3>> make_openings()
+{
+    std::vector<std::array<int, 3>> out;
+    std::vector<uint64_t> seen;
+    int centre = 7 * BOARD_SIZE + 7;
+    for (int second : {centre + 1, centre + BOARD_SIZE + 1})
+        for (int dr = -2; dr <= 2; dr++)
+            for (int dc = -2; dc <= 2; dc++)
+            {
+                int third = centre + dr * BOARD_SIZE + dc;
+                if (third == centre || third == second)
+                    continue;
+                AI_Board b;
+                b.clear();
+                b.play(centre, 1);
+                b.play(second, -1);
+                b.play(third, 1);
+                int sym;
+                uint64_t key = book_key(b, -1, &sym);
+                if (std::find(seen.begin(), seen.end(), key) != seen.end())
+                    continue;
+                seen.push_back(key);
+                out.push_back({centre, second, third});
+            }
+    return out;
+}
+
+// Plays one game; returns 1 if black won, -1 if white won, 0 for a draw.
+// black is 0 for engine A, 1 for engine B.
+static int play_game(const std::array<int, 3> &opening, ArenaPlayer *players[2], int black, EngineStats st[2])
+{
+    AI_Board pos;
+    pos.clear();
+    for (int i = 0; i < 2; i++)
+        players[i]->start();
+    int p = 1;
+    for (int ply = 0; ply < ARENA_MAX_PLIES; ply++, p = -p)
+    {
+        int side = p == 1 ? black : black ^ 1;
+        int m = ply < 3 ? opening[ply] : players[side]->choose(pos, p, st[side]);
+        if (m < 0 || m >= CELLS || pos.at(m) != 0)
+            return -p; // no move or an illegal one loses
+        pos.play(m, p);
+        for (int i = 0; i < 2; i++)
+            players[i]->played(m, p);
+        if (pos.win_at(m))
+            return p;
+    }
+    return 0;
+}
+
+static void arena_worker(const EngineSpec *specs, const std::vector<std::array<int, 3>> *openings,
+                         std::atomic<int> *next_game, ArenaTotals *totals)
+{
+    ArenaPlayer a, b;
+    a.spec = &specs[0];
+    b.spec = &specs[1];
+    ArenaPlayer *players[2] = {&a, &b};
+    int games = (int)openings->size() * 2;
+    for (int g; (g = next_game->fetch_add(1)) < games;)
+    {
+        EngineStats st[2];
+        int black = g % 2;
+        int result = play_game((*openings)[g / 2], players, black, st);
+        int a_colour = black == 0 ? 1 : -1;
+
+        std::lock_guard<std::mutex> lock(totals->mutex);
+        if (result == 0)
+            totals->draws++;
+        else if (result == a_colour)
+            totals->a_wins++;
+        else
+            totals->b_wins++;
+        for (int i = 0; i < 2; i++)
+        {
+            EngineStats &t = totals->stats[i];
+            t.latency_us.insert(t.latency_us.end(), st[i].latency_us.begin(), st[i].latency_us.end());
+            t.nodes += st[i].nodes;
+            t.search_us += st[i].search_us;
+            t.max_depth = std::max(t.max_depth, st[i].max_depth);
+        }
+        int done = totals->a_wins + totals->b_wins + totals->draws;
+        printf("\rgames %d/%d  A %d  B %d  draws %d", done, games, totals->a_wins, totals->b_wins, totals->draws);
+        fflush(stdout);
+    }
+}
+
+static double elo(double score)
+{
+    score = std::min(std::max(score, 1e-3), 1 - 1e-3);
+    return -400 * log10(1 / score - 1);
+}
+
+static void print_engine(const char *label, const EngineSpec &spec, EngineStats &st)
+{
+    std::sort(st.latency_us.begin(), st.latency_us.end());
+    auto pct = [&](double q) {
+        return st.latency_us.empty() ? 0.0 : st.latency_us[(size_t)(q * (st.latency_us.size() - 1))] / 1000.0;
+    };
+    printf("%-2s %-22s %8zu %12.0f %6d %10.2f %10.2f %10.2f\n", label, spec.name.c_str(), st.latency_us.size(),
+           spec.kind == ENGINE_NATIVE && st.search_us ? st.nodes / (st.search_us / 1e6) : 0.0, st.max_depth, pct(0.5),
+           pct(0.99), pct(1.0));
+}
+
+int main(int argc, char **argv)
+{
+    EngineSpec specs[2];
+    if (!parse_engine(argc > 1 ? argv[1] : "native:100", specs[0]) ||
+        !parse_engine(argc > 2 ? argv[2] : "native:50", specs[1]))
+    {
+        printf("engines: native[:budget_ms[:max_depth[:tt_mb]]] or legacy\n");
+        return 2;
+    }
+    std::vector<std::array<int, 3>> openings = make_openings();
+    if (argc > 3 && atoi(argv[3]) > 0)
+        openings.resize(std::min(openings.size(), (size_t)atoi(argv[3])));
+    int threads = argc > 4 ? std::max(1, atoi(argv[4])) : std::max(1u, std::thread::hardware_concurrency());
+    load_opening_book(""); // measure the engines, not a book
+
+    ArenaTotals totals;
+    std::atomic<int> next_game{0};
+    std::vector<std::thread> workers;
+    int64_t t0 = now_us();
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(arena_worker, specs, &openings, &next_game, &totals);
+    for (std::thread &t : workers)
+        t.join();
+
+    int n = totals.a_wins + totals.b_wins + totals.draws;
+    double score = (totals.a_wins + 0.5 * totals.draws) / n;
+    // Per-game score variance around the mean, for the normal interval.
+    double var = (totals.a_wins * (1 - score) * (1 - score) + totals.draws * (0.5 - score) * (0.5 - score) +
+                  totals.b_wins * score * score) / n;
+    double margin = 1.96 * sqrt(var / n);
+    double low = std::max(score - margin, 0.0), high = std::min(score + margin, 1.0);
+    printf("\n\n%d games from %zu openings in %.1f s on %d threads\n", n, openings.size(), (now_us() - t0) / 1e6,
+           threads);
+    printf("A score %.1f%% (95%% CI %.1f%% .. %.1f%%), Elo %+.0f (%+.0f .. %+.0f)\n\n", score * 100,
+           low * 100, high * 100, elo(score), elo(low), elo(high));
+    printf("%-2s %-22s %8s %12s %6s %10s %10s %10s\n", "", "engine", "moves", "nodes/s", "depth", "p50 ms", "p99 ms",
+           "max ms");
+    print_engine("A", specs[0], totals.stats[0]);
+    print_engine("B", specs[1], totals.stats[1]);
+    return high < 0.5 ? 1 : 0;
+}
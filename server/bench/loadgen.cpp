@@ -0,0 +1,225 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread loadgen.cpp -o loadgen
+// 실행 : ./loadgen [host] [port] [connections] [per_room] [moves_per_sec] [seconds] [threads]
+//
+// Load generator for the native server. Opens many connections spread over
+// rooms of per_room clients, each sending MOVE at a fixed rate, a PLACE now
+// and then, and a PING every second. Reports PING round trips (p50/p99/max),
+// frames and bytes received per second, and dropped connections.
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MSG_WELCOME 1
+#define MSG_FRAME 2
+#define MSG_PONG 3
+#define PLACE_PERCENT 2
+
+static int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct Client {
+    int fd;
+    long long room;
+    int64_t next_move;
+    int64_t next_ping;
+    std::vector<uint8_t> in;
+};
+
+struct LoadStats {
+    long long frames = 0;
+    long long bytes = 0;
+    long long dropped = 0;
+    std::vector<int> rtt_us;
+};
+
+struct LoadConfig {
+    sockaddr_in addr;
+    int per_room;
+    int moves_per_sec;
+    int64_t until;
+};
+
+static int connect_to(const sockaddr_in &addr) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static bool send_line(int fd, const char *line, int n) {
+    return send(fd, line, n, MSG_NOSIGNAL) == n;
+}
+
+static uint64_t get_varint(const uint8_t *p, const uint8_t *end) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end; shift += 7) {
+        v |= (uint64_t)(*p & 0x7f) << shift;
+        if (!(*p++ & 0x80))
+            break;
+    }
+    return v;
+}
+
+// Consumes every complete message in the client's input buffer.
+static void read_messages(Client &c, LoadStats &st) {
+    size_t at = 0;
+    while (c.in.size() - at >= 3) {
+        const uint8_t *m = c.in.data() + at;
+        size_t n = m[1] | (m[2] << 8);
+        if (c.in.size() - at < n + 3)
+            break;
+        if (m[0] == MSG_FRAME)
+            st.frames++;
+        else if (m[0] == MSG_PONG)
+            st.rtt_us.push_back((int)(now_us() - (int64_t)get_varint(m + 3, m + 3 + n)));
+        at += n + 3;
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + at);
+}
+
+static void load_worker(const LoadConfig &cfg, int first, int count, LoadStats *out) {
+    std::mt19937 rng(first + 1);
+    int epfd = epoll_create1(0);
+    std::vector<Client> clients(count);
+    LoadStats st;
+    int64_t start = now_us();
+    for (int i = 0; i < count; i++) {
+        Client &c = clients[i];
+        c.fd = connect_to(cfg.addr);
+        c.room = (first + i) / cfg.per_room;
+        c.next_move = start + (int64_t)(rng() % 1000000) / cfg.moves_per_sec;
+        c.next_ping = start + (int64_t)(rng() % 1000000);
+        if (c.fd < 0) {
+            st.dropped++;
+            continue;
+        }
+        char line[64];
+        int n = snprintf(line, sizeof(line), "JOIN %lld\n", c.room);
+        send_line(c.fd, line, n);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u32 = (uint32_t)i;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    int64_t interval = 1000000 / cfg.moves_per_sec;
+    epoll_event events[256];
+    uint8_t buf[65536];
+    while (now_us() < cfg.until) {
+        int n = epoll_wait(epfd, events, 256, 1);
+        for (int i = 0; i < n; i++) {
+            Client &c = clients[events[i].data.u32];
+            ssize_t got = recv(c.fd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (got <= 0) {
+                if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    continue;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+                close(c.fd);
+                c.fd = -1;
+                st.dropped++;
+                continue;
+            }
+            st.bytes += got;
+            c.in.insert(c.in.end(), buf, buf + got);
+            read_messages(c, st);
+        }
+
+        int64_t t = now_us();
+        for (Client &c : clients) {
+            if (c.fd < 0)
+                continue;
+            char line[64];
+            if (t >= c.next_move) {
+                int len;
+                if ((int)(rng() % 100) < PLACE_PERCENT)
+                    len = snprintf(line, sizeof(line), "PLACE %d %d\n", (int)(rng() % 15), (int)(rng() % 15));
+                else
+                    len = snprintf(line, sizeof(line), "MOVE %d %d\n", (int)(rng() % 3) - 1, (int)(rng() % 3) - 1);
+                send_line(c.fd, line, len);
+                c.next_move += interval;
+            }
+            if (t >= c.next_ping) {
+                int len = snprintf(line, sizeof(line), "PING %lld\n", (long long)t);
+                send_line(c.fd, line, len);
+                c.next_ping += 1000000;
+            }
+        }
+    }
+    for (Client &c : clients)
+        if (c.fd >= 0)
+            close(c.fd);
+    close(epfd);
+    *out = std::move(st);
+}
+
+int main(int argc, char **argv) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 5000;
+    int connections = argc > 3 ? std::max(1, atoi(argv[3])) : 1000;
+    int per_room = argc > 4 ? std::max(1, atoi(argv[4])) : 10;
+    int moves_per_sec = argc > 5 ? std::max(1, atoi(argv[5])) : 10;
+    int seconds = argc > 6 ? std::max(1, atoi(argv[6])) : 10;
+    int threads = argc > 7 ? std::max(1, atoi(argv[7])) : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, connections);
+
+    LoadConfig cfg;
+    memset(&cfg.addr, 0, sizeof(cfg.addr));
+    cfg.addr.sin_family = AF_INET;
+    cfg.addr.sin_port = htons(port);
+    inet_pton(AF_INET, host, &cfg.addr.sin_addr);
+    cfg.per_room = per_room;
+    cfg.moves_per_sec = moves_per_sec;
+    int64_t t0 = now_us();
+    cfg.until = t0 + (int64_t)seconds * 1000000;
+
+    std::vector<std::thread> workers;
+    std::vector<LoadStats> stats(threads);
+    for (int i = 0; i < threads; i++) {
+        int first = (int)((long long)connections * i / threads);
+        int last = (int)((long long)connections * (i + 1) / threads);
+        workers.emplace_back(load_worker, std::cref(cfg), first, last - first, &stats[i]);
+    }
+    LoadStats total;
+    for (int i = 0; i < threads; i++) {
+        workers[i].join();
+        total.frames += stats[i].frames;
+        total.bytes += stats[i].bytes;
+        total.dropped += stats[i].dropped;
+        total.rtt_us.insert(total.rtt_us.end(), stats[i].rtt_us.begin(), stats[i].rtt_us.end());
+    }
+    double secs = (now_us() - t0) / 1e6;
+    std::sort(total.rtt_us.begin(), total.rtt_us.end());
+    auto pct = [&](double q) {
+        return total.rtt_us.empty() ? 0 : total.rtt_us[(size_t)(q * (total.rtt_us.size() - 1))];
+    };
+
+    printf("connections %d in %d rooms, %d moves/s each, %.1f s\n", connections,
+           (connections + per_room - 1) / per_room, moves_per_sec, secs);
+    printf("frames/s    %.0f\n", total.frames / secs);
+    printf("MB/s        %.2f\n", total.bytes / secs / 1e6);
+    printf("ping        p50 %d us, p99 %d us, max %d us (%zu samples)\n", pct(0.5), pct(0.99), pct(1.0),
+           total.rtt_us.size());
+    printf("dropped     %lld\n", total.dropped);
+    return 0;
+}
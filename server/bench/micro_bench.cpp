@@ -0,0 +1,423 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread micro_bench.cpp -o micro_bench (또는 bash build_native.sh bench)
+// 실행 : ./micro_bench [--filter=substring] [--min_time=seconds] [--json=out.json]
+//
+// Microbenchmarks for the hot paths behind the exports, in the manner of
+// Google Benchmark without depending on it: every case runs a loop whose
+// iteration count is grown until it takes at least min_time, and setup
+// inside the loop is excluded with pause()/resume().
+//
+//   Rooms, by stones on the board (empty 0, mid 60, near_full 200) and
+//   players in the room (1, 10, 50): move_player, place_stone, get_state,
+//   get_state_frame.
+//   Fixed positions (opening and midgame from deterministic self-play,
+//   near_full as above): AI_Board candidates, evaluate, win_at, negamax at
+//   depths 1-4 without a table, and get_ai_move from a cold table.
+//
+// --json writes the results in Google Benchmark's JSON layout (context plus
+// one entry per case with real_time/cpu_time in ns and any counters), so
+// runs from different commits can be diffed with its compare.py.
+#include "../game_logic.cpp"
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <random>
+
+#define BENCH_ROOM_BASE 8000000000LL
+#define PLACE_BATCH 8
+
+static int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static int64_t cpu_ns()
+{
+    return (int64_t)std::clock() * (1000000000LL / CLOCKS_PER_SEC);
+}
+
+// Loop control handed to each case: while (st.keep_running()) { ... }
+struct BenchState
+{
+    int64_t iterations = 1;
+    int64_t done = 0;
+    int64_t real_ns = 0, cpu_ns_used = 0;
+    int64_t real_start = 0, cpu_start = 0;
+    double items = 0; // counted work, reported per second under items_name
+    const char *items_name = nullptr;
+
+    bool keep_running()
+    {
+        if (done == 0)
+            resume();
+        if (done < iterations)
+        {
+            done++;
+            return true;
+        }
+        pause();
+        return false;
+    }
+
+    void pause()
+    {
+        real_ns += now_ns() - real_start;
+        cpu_ns_used += cpu_ns() - cpu_start;
+    }
+
+    void resume()
+    {
+        real_start = now_ns();
+        cpu_start = cpu_ns();
+    }
+};
+
+struct Benchmark
+{
+    std::string name;
+    std::function<void(BenchState &)> fn;
+};
+
+struct BenchResult
+{
+    std::string name;
+    int64_t iterations;
+    double real_ns, cpu_ns; // per iteration
+    const char *items_name;
+    double items_per_sec;
+};
+
+static std::vector<Benchmark> benchmarks;
+
+static void add_bench(const std::string &name, std::function<void(BenchState &)> fn)
+{
+    benchmarks.push_back({name, std::move(fn)});
+}
+
+// Grows the iteration count until one run lasts min_time, like Google
+// Benchmark: aim 40% past the target from the last run's rate, at most 10x.
+static BenchResult run_bench(const Benchmark &bm, double min_time)
+{
+    int64_t target = (int64_t)(min_time * 1e9);
+    for (int64_t iters = 1;;)
+    {
+        BenchState st;
+        st.iterations = iters;
+        bm.fn(st);
+        if (st.real_ns >= target || iters >= 1000000000)
+            return {bm.name, iters, (double)st.real_ns / iters, (double)st.cpu_ns_used / iters, st.items_name,
+                    st.real_ns ? st.items * 1e9 / st.real_ns : 0.0};
+        double per = std::max<double>(st.real_ns, 1) / iters;
+        iters = std::max(iters + 1, std::min(iters * 10, (int64_t)(target * 1.4 / per)));
+    }
+}
+
+// --- Positions ---
+
+struct Position
+{
+    const char *name;
+    std::vector<int> moves; // cells in play order, black first
+};
+
+// Plays the cells of a shuffled board alternately, skipping any that would
+// make five, so the position stays undecided however full it gets.
+static std::vector<int> fill_position(int stones)
+{
+    std::mt19937 rng(12345);
+    std::vector<int> cells(CELLS);
+    for (int i = 0; i < CELLS; i++)
+        cells[i] = i;
+    std::shuffle(cells.begin(), cells.end(), rng);
+    AI_Board b;
+    b.clear();
+    std::vector<int> out;
+    for (int p = 1; (int)out.size() < stones; p = -p)
+    {
+        size_t i = 0;
+        for (; i < cells.size(); i++)
+        {
+            b.play(cells[i], p);
+            bool five = b.win_at(cells[i]);
+            b.undo(cells[i], p);
+            if (!five)
+                break;
+        }
+        if (i == cells.size())
+            break;
+        b.play(cells[i], p);
+        out.push_back(cells[i]);
+        cells.erase(cells.begin() + i);
+    }
+    return out;
+}
+
+static void load_room(long long room_id, const std::vector<int> &moves, int players)
+{
+    init_game(room_id);
+    reset_game(room_id);
+    for (int i = 0; i < (int)moves.size(); i++)
+        place_stone(room_id, moves[i] / BOARD_SIZE, moves[i] % BOARD_SIZE, i % 2 == 0 ? 1 : 2);
+    for (int id = 0; id < players; id++)
+    {
+        // Spread the players out from the centre so they differ.
+        int r, c;
+        move_player(room_id, id, id % 5 - 2, id / 5 % 5 - 2, &r, &c);
+    }
+}
+
+// The engine plays itself at get_ai_move's depth from the centre.
+static std::vector<int> self_play_position(int plies)
+{
+    long long room_id = BENCH_ROOM_BASE + 999;
+    load_room(room_id, {}, 0);
+    std::vector<int> out;
+    for (int i = 0; i < plies; i++)
+    {
+        int color = i % 2 == 0 ? 1 : 2, r, c;
+        get_ai_move(room_id, color, &r, &c);
+        if (!place_stone(room_id, r, c, color))
+            break;
+        out.push_back(r * BOARD_SIZE + c);
+    }
+    destroy_room(room_id);
+    return out;
+}
+
+static void load_board(AI_Board &b, const std::vector<int> &moves)
+{
+    b.clear();
+    for (int i = 0; i < (int)moves.size(); i++)
+        b.play(moves[i], i % 2 == 0 ? 1 : -1);
+    b.turn = moves.size() % 2 == 0 ? 1 : -1;
+}
+
+// --- Room cases ---
+
+static void register_room_benches(const std::vector<Position> &rooms)
+{
+    static const int player_counts[] = {1, 10, 50};
+    long long next_room = BENCH_ROOM_BASE;
+    for (const Position &pos : rooms)
+        for (int players : player_counts)
+        {
+            long long room_id = next_room++;
+            std::string suffix = std::string("/") + pos.name + "/players:" + std::to_string(players);
+            const std::vector<int> *moves = &pos.moves;
+
+            add_bench("BM_move_player" + suffix, [=](BenchState &st) {
+                load_room(room_id, *moves, players);
+                int r, c;
+                for (int64_t k = 0; st.keep_running(); k++)
+                {
+                    // Each player steps right then back, so everyone stays put on average.
+                    int id = (int)(k % players);
+                    move_player(room_id, id, (k / players) % 2 == 0 ? 1 : -1, 0, &r, &c);
+                }
+            });
+
+            add_bench("BM_get_state" + suffix, [=](BenchState &st) {
+                load_room(room_id, *moves, players);
+                std::vector<int> p_buf(MAX_PLAYERS * 3), s_buf(MAX_STONES * 3 + 1);
+                int p_count, s_count;
+                while (st.keep_running())
+                    get_state(room_id, p_buf.data(), &p_count, s_buf.data(), &s_count);
+            });
+
+            add_bench("BM_get_state_frame" + suffix, [=](BenchState &st) {
+                load_room(room_id, *moves, players);
+                std::vector<unsigned char> buf(FRAME_MAX_BYTES(MAX_PLAYERS));
+                long long version;
+                int bytes = 0;
+                while (st.keep_running())
+                    bytes += get_state_frame(room_id, -1, buf.data(), (int)buf.size(), &version);
+                st.items = bytes;
+                st.items_name = "bytes_per_second";
+            });
+        }
+
+    // place_stone changes the board, so the room is rebuilt (untimed) after
+    // every PLACE_BATCH stones; the fill level stays within a few stones.
+    for (const Position &pos : rooms)
+    {
+        long long room_id = next_room++;
+        std::vector<int> moves = fill_position((int)pos.moves.size() + PLACE_BATCH);
+        int base = (int)pos.moves.size();
+        add_bench(std::string("BM_place_stone/") + pos.name, [=](BenchState &st) {
+            std::vector<int> prefix(moves.begin(), moves.begin() + base);
+            load_room(room_id, prefix, 1);
+            int i = base;
+            while (st.keep_running())
+            {
+                if (i == (int)moves.size())
+                {
+                    st.pause();
+                    load_room(room_id, prefix, 1);
+                    i = base;
+                    st.resume();
+                }
+                place_stone(room_id, moves[i] / BOARD_SIZE, moves[i] % BOARD_SIZE, i % 2 == 0 ? 1 : 2);
+                i++;
+            }
+        });
+    }
+}
+
+// --- Search cases ---
+
+static void register_search_benches(const std::vector<Position> &positions)
+{
+    long long room_id = BENCH_ROOM_BASE + 500;
+    for (const Position &pos : positions)
+    {
+        std::string suffix = std::string("/") + pos.name;
+        const std::vector<int> *moves = &pos.moves;
+
+        add_bench("BM_candidates" + suffix, [=](BenchState &st) {
+            AI_Board b;
+            MoveList ml;
+            load_board(b, *moves);
+            int n = 0;
+            while (st.keep_running())
+            {
+                b.candidates(ml);
+                n += ml.n;
+            }
+            st.items = n;
+            st.items_name = "moves_per_second";
+        });
+
+        add_bench("BM_evaluate" + suffix, [=](BenchState &st) {
+            AI_Board b;
+            load_board(b, *moves);
+            volatile int sink = 0;
+            while (st.keep_running())
+                sink = sink + b.evaluate();
+        });
+
+        add_bench("BM_win_at" + suffix, [=](BenchState &st) {
+            AI_Board b;
+            load_board(b, *moves);
+            volatile int sink = 0;
+            size_t i = 0;
+            while (st.keep_running())
+            {
+                // Every stone of the position in turn.
+                sink = sink + b.win_at((*moves)[i]);
+                if (++i == moves->size())
+                    i = 0;
+            }
+        });
+
+        for (int depth = 1; depth <= 4; depth++)
+            add_bench("BM_negamax" + suffix + "/depth:" + std::to_string(depth), [=](BenchState &st) {
+                AI_Board b;
+                load_board(b, *moves);
+                uint64_t nodes = 0;
+                while (st.keep_running())
+                {
+                    st.pause();
+                    b.nodes = 0;
+                    memset(b.killers, -1, sizeof(b.killers));
+                    memset(b.history, 0, sizeof(b.history));
+                    st.resume();
+                    b.negamax(depth, -INF, INF);
+                    nodes += b.nodes;
+                }
+                st.items = (double)nodes;
+                st.items_name = "nodes_per_second";
+            });
+
+        add_bench("BM_get_ai_move" + suffix, [=](BenchState &st) {
+            load_room(room_id, *moves, 1);
+            int color = moves->size() % 2 == 0 ? 1 : 2, r, c;
+            while (st.keep_running())
+            {
+                st.pause();
+                GameRoom *room = room_registry.find(room_id);
+                if (room->tt)
+                    room->tt->clear();
+                st.resume();
+                get_ai_move(room_id, color, &r, &c);
+            }
+        });
+    }
+}
+
+// --- Output ---
+
+static void write_json(const char *path, const char *exe, const std::vector<BenchResult> &results)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        printf("cannot write %s\n", path);
+        return;
+    }
+    char date[64];
+    time_t t = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&t));
+    fprintf(f, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\",\n", date, exe);
+    fprintf(f, "    \"num_cpus\": %u,\n    \"library_build_type\": \"release\"\n  },\n",
+            std::thread::hardware_concurrency());
+    fprintf(f, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(f, "    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n      \"run_type\": \"iteration\",\n",
+                r.name.c_str(), r.name.c_str());
+        fprintf(f, "      \"iterations\": %lld,\n      \"real_time\": %.3f,\n      \"cpu_time\": %.3f,\n",
+                (long long)r.iterations, r.real_ns, r.cpu_ns);
+        if (r.items_name)
+            fprintf(f, "      \"%s\": %.3f,\n", r.items_name, r.items_per_sec);
+        fprintf(f, "      \"time_unit\": \"ns\"\n    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    const char *filter = "", *json = nullptr;
+    double min_time = 0.2;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else if (strncmp(argv[i], "--min_time=", 11) == 0)
+            min_time = std::max(0.001, atof(argv[i] + 11));
+        else if (strncmp(argv[i], "--json=", 7) == 0)
+            json = argv[i] + 7;
+        else
+        {
+            printf("usage: %s [--filter=substring] [--min_time=seconds] [--json=out.json]\n", argv[0]);
+            return 1;
+        }
+    }
+    set_ai_threads(1);
+    load_opening_book(""); // time the search, not a book lookup
+
+    std::vector<Position> rooms = {{"empty", {}}, {"mid", fill_position(60)}, {"near_full", fill_position(200)}};
+    std::vector<Position> positions = {
+        {"opening", self_play_position(8)}, {"midgame", self_play_position(20)}, {"near_full", rooms[2].moves}};
+    register_room_benches(rooms);
+    register_search_benches(positions);
+
+    printf("%-44s %14s %14s %12s  %s\n", "Benchmark", "Time", "CPU", "Iterations", "Counters");
+    std::vector<BenchResult> results;
+    for (const Benchmark &bm : benchmarks)
+    {
+        if (bm.name.find(filter) == std::string::npos)
+            continue;
+        BenchResult r = run_bench(bm, min_time);
+        printf("%-44s %11.0f ns %11.0f ns %12lld", r.name.c_str(), r.real_ns, r.cpu_ns, (long long)r.iterations);
+        if (r.items_name)
+            printf("  %s=%.4g", r.items_name, r.items_per_sec);
+        printf("\n");
+        fflush(stdout);
+        results.push_back(r);
+    }
+    if (json)
+        write_json(json, argv[0], results);
+    return 0;
+}
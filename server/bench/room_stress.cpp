@@ -0,0 +1,168 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread room_stress.cpp -o room_stress
+// 실행 : ./room_stress [threads] [seconds]
+//
+// Hammers the room exports from many threads at once: move_player,
+// remove_player, place_stone and reset_game write, get_state reads. Every
+// snapshot a reader gets must be a state some sequence of writes could
+// have produced (colours alternate from black, the turn matches the stone
+// count, no cell twice, players inside the board with unique ids). Runs
+// once with every thread on a single room and once with one room per
+// thread, and prints throughput and the number of broken snapshots.
+// Checks first that a slot reused after destroying a dirty room still
+// ticks. Exits with 1 if that check fails or any snapshot is broken.
+#include "../game_logic.cpp"
+#include <cstdio>
+#include <random>
+
+#define STRESS_ROOM_BASE 9000000000LL
+
+struct StressCounters
+{
+    long long writes = 0;
+    long long reads = 0;
+    long long bad = 0;
+};
+
+// Checks one get_state snapshot; returns false if it is inconsistent.
+static bool valid_snapshot(const int *p_buf, int p_count, const int *s_buf, int s_count)
+{
+    if (p_count < 0 || p_count > MAX_PLAYERS || s_count < 0 || s_count > MAX_STONES)
+        return false;
+    bool seen[BOARD_SIZE * BOARD_SIZE] = {};
+    for (int i = 0; i < s_count; i++)
+    {
+        int r = s_buf[i * 3], c = s_buf[i * 3 + 1], color = s_buf[i * 3 + 2];
+        if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE || seen[r * BOARD_SIZE + c])
+            return false;
+        if (color != (i % 2 == 0 ? 1 : 2))
+            return false;
+        seen[r * BOARD_SIZE + c] = true;
+    }
+    if (s_buf[s_count * 3] != (s_count % 2 == 0 ? 1 : 2))
+        return false;
+    for (int i = 0; i < p_count; i++)
+    {
+        if (!inside(p_buf[i * 3 + 1], p_buf[i * 3 + 2]))
+            return false;
+        for (int j = 0; j < i; j++)
+            if (p_buf[j * 3] == p_buf[i * 3])
+                return false;
+    }
+    return true;
+}
+
+static void stress_worker(int id, int rooms, int64_t until, StressCounters *out)
+{
+    std::mt19937 rng(1234 + id);
+    int p_buf[MAX_PLAYERS * 3], s_buf[MAX_STONES * 3 + 1];
+    StressCounters n;
+    while (now_us() < until)
+    {
+        for (int k = 0; k < 256; k++)
+        {
+            long long room = STRESS_ROOM_BASE + (rooms == 1 ? 0 : id % rooms);
+            int op = rng() % 100;
+            if (op < 45)
+            {
+                int r, c;
+                move_player(room, id * 8 + (int)(rng() % 8), (int)(rng() % 3) - 1, (int)(rng() % 3) - 1, &r, &c);
+                n.writes++;
+            }
+            else if (op < 50)
+            {
+                remove_player(room, id * 8 + (int)(rng() % 8));
+                n.writes++;
+            }
+            else if (op < 70)
+            {
+                place_stone(room, (int)(rng() % BOARD_SIZE), (int)(rng() % BOARD_SIZE), 1 + (int)(rng() % 2));
+                n.writes++;
+            }
+            else if (op < 71)
+            {
+                reset_game(room);
+                n.writes++;
+            }
+            else
+            {
+                int p_count, s_count;
+                get_state(room, p_buf, &p_count, s_buf, &s_count);
+                if (!valid_snapshot(p_buf, p_count, s_buf, s_count))
+                    n.bad++;
+                n.reads++;
+            }
+        }
+    }
+    *out = n;
+}
+
+// A room destroyed with a cursor change still waiting for its tick must
+// not leave that state behind in its slot: the next room there has to get
+// its own changes handed out by next_tick.
+static bool check_slot_reuse()
+{
+    long long old_id = STRESS_ROOM_BASE - 1, new_id = STRESS_ROOM_BASE - 2;
+    int r, c;
+    init_game(old_id);
+    GameRoom *slot = room_registry.find(old_id);
+    move_player(old_id, 1, 1, 0, &r, &c);
+    destroy_room(old_id);
+    long long ids[64];
+    while (next_tick(ids, 64) > 0)
+    {
+    }
+    init_game(new_id);
+    bool reused = room_registry.find(new_id) == slot;
+    move_player(new_id, 1, 1, 0, &r, &c);
+    bool handed_out = false;
+    for (int tick = 0; tick < 3 && !handed_out; tick++)
+    {
+        int n = next_tick(ids, 64);
+        handed_out = std::find(ids, ids + n, new_id) != ids + n;
+    }
+    destroy_room(new_id);
+    printf("slot reuse: %s%s\n", handed_out ? "ok" : "FAILED, changes of the new room never ticked",
+           reused ? "" : " (slot was not reused)");
+    return handed_out;
+}
+
+// Returns false if any snapshot was broken.
+static bool run(int threads, int rooms, int seconds)
+{
+    for (int i = 0; i < rooms; i++)
+    {
+        init_game(STRESS_ROOM_BASE + i);
+        reset_game(STRESS_ROOM_BASE + i);
+    }
+    std::thread workers[256];
+    StressCounters counters[256];
+    int64_t t0 = now_us();
+    int64_t until = t0 + (int64_t)seconds * 1000000;
+    for (int i = 0; i < threads; i++)
+        workers[i] = std::thread(stress_worker, i, rooms, until, &counters[i]);
+    StressCounters total;
+    for (int i = 0; i < threads; i++)
+    {
+        workers[i].join();
+        total.writes += counters[i].writes;
+        total.reads += counters[i].reads;
+        total.bad += counters[i].bad;
+    }
+    double secs = (now_us() - t0) / 1e6;
+    printf("%-8d %-6d %14.0f %14.0f %10lld\n", threads, rooms, total.writes / secs, total.reads / secs, total.bad);
+    for (int i = 0; i < rooms; i++)
+        destroy_room(STRESS_ROOM_BASE + i);
+    return total.bad == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int threads = argc > 1 ? std::max(1, std::min(atoi(argv[1]), 256)) : 8;
+    int seconds = argc > 2 ? std::max(1, atoi(argv[2])) : 2;
+
+    bool ok = check_slot_reuse();
+    printf("%-8s %-6s %14s %14s %10s\n", "threads", "rooms", "writes/s", "reads/s", "broken");
+    ok = run(threads, 1, seconds) && ok;
+    ok = run(threads, threads, seconds) && ok;
+    return ok ? 0 : 1;
+}
@@ -1,12 +1,32 @@
 #include <cstring>
-#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_JOURNAL 1
+#define HAVE_MMAP 1
+#endif
+
+#include "game_logic.h"
 
-#define BOARD_SIZE 15
-#define MAX_ROOMS 10
-#define MAX_PLAYERS 50
-#define MAX_STONES 256
 #define INF 1e9
+#define AI_MAX_DEPTH 32
+#define AI_MAX_PLY (AI_MAX_DEPTH + 1)
 
 struct Player
 {
@@ -21,15 +41,585 @@ struct Stone
     int color; // 1: Black, 2: White
 };
 
+// --- Players -------------------------------------------------------------
+// Each room's players sit in stable slots found by id through an
+// open-addressing index (linear probing, backward-shift deletion). A dense
+// list of occupied slots makes snapshots proportional to the players
+// present, and vacated slots are reused through a free list. The capacity
+// is fixed when the room is created, from player_capacity.
+//
+// A table's arrays never change after construction, so a seqlock reader
+// that loaded a room's table pointer stays inside memory of the right size
+// whatever a writer does meanwhile. A room created with a larger capacity
+// than its slot's table gets a new table; the old one is retired, never
+// freed, since a reader may still be in it.
+int player_capacity = MAX_PLAYERS;
+
+struct PlayerTable
+{
+    Player *const slots;
+    int *const active;     // occupied slots, dense
+    int *const active_pos; // slot -> position in active
+    int *const next_free;  // free list links
+    const int allocated;   // slots in the arrays
+    const int index_mask;
+    int *const index;      // id -> slot, -1 empty
+    int capacity = 0;      // <= allocated
+    int count = 0;         // occupied slots
+    int used = 0;          // slots handed out at least once
+    int free_head = -1;
+
+    explicit PlayerTable(int cap)
+        : slots(new Player[cap]()), active(new int[cap]), active_pos(new int[cap]), next_free(new int[cap]),
+          allocated(cap), index_mask(index_size(cap) - 1), index(new int[index_size(cap)])
+    {
+        reset(cap);
+    }
+
+    PlayerTable(const PlayerTable &) = delete;
+    PlayerTable &operator=(const PlayerTable &) = delete;
+
+    static int index_size(int cap)
+    {
+        int n = 4;
+        while (n < 2 * cap)
+            n *= 2;
+        return n;
+    }
+
+    // Empties the table for cap <= allocated players. Caller holds a RoomWrite.
+    void reset(int cap)
+    {
+        memset(index, -1, (index_mask + 1) * sizeof(int));
+        capacity = cap;
+        count = 0;
+        used = 0;
+        free_head = -1;
+    }
+
+    int home(int id) const
+    {
+        uint32_t h = (uint32_t)id * 0x9E3779B1u;
+        return (int)(h ^ (h >> 16)) & index_mask;
+    }
+
+    // Index position holding id, or the empty one where it would go.
+    int probe(int id) const
+    {
+        int i = home(id);
+        while (index[i] != -1 && slots[index[i]].id != id)
+            i = (i + 1) & index_mask;
+        return i;
+    }
+
+    Player *find(int id) const
+    {
+        int slot = index[probe(id)];
+        return slot != -1 ? &slots[slot] : nullptr;
+    }
+
+    // Adds a player at the centre; null if the room is full.
+    Player *add(int id)
+    {
+        int slot;
+        if (free_head != -1)
+        {
+            slot = free_head;
+            free_head = next_free[slot];
+        }
+        else if (used < capacity)
+            slot = used++;
+        else
+            return nullptr;
+        Player *p = &slots[slot];
+        p->id = id;
+        p->r = BOARD_SIZE / 2;
+        p->c = BOARD_SIZE / 2;
+        p->active = true;
+        index[probe(id)] = slot;
+        active_pos[slot] = count;
+        active[count++] = slot;
+        return p;
+    }
+
+    bool remove(int id)
+    {
+        int i = probe(id);
+        int slot = index[i];
+        if (slot == -1)
+            return false;
+        // Backward-shift the rest of the cluster into the hole.
+        for (int j = (i + 1) & index_mask; index[j] != -1; j = (j + 1) & index_mask)
+        {
+            int h = home(slots[index[j]].id);
+            if (((j - h) & index_mask) >= ((j - i) & index_mask))
+            {
+                index[i] = index[j];
+                i = j;
+            }
+        }
+        index[i] = -1;
+        int pos = active_pos[slot];
+        active[pos] = active[--count];
+        active_pos[active[pos]] = pos;
+        slots[slot].active = false;
+        next_free[slot] = free_head;
+        free_head = slot;
+        return true;
+    }
+};
+
+std::vector<PlayerTable *> retired_player_tables; // guarded by the registry's lock
+
+// --- Change log ----------------------------------------------------------
+// Every change to a room bumps its version and is recorded in a ring, so a
+// client that knows version v can be sent only what changed after it.
+#define ROOM_LOG_SIZE 64
+
+enum RoomChangeKind
+{
+    CHANGE_PLAYER, // player added, moved or removed
+    CHANGE_STONE,  // stone appended
+    CHANGE_RESET   // board cleared; deltas cannot cross it
+};
+
+struct RoomChange
+{
+    int kind;
+    int player_id;
+    int stones_before; // stone_count before the change
+};
+
+// --- Search statistics ---------------------------------------------------
+// With -DAI_STATS every search counts its nodes, table hits and cutoffs and
+// times each phase of choose_move; the last search of each room is kept for
+// get_ai_stats and every search lands in a global latency histogram.
+// Without it AI_STAT(...) expands to nothing and searches carry no extra
+// state; the exports stay so callers need not care, and report -1.
+#ifdef AI_STATS
+#define AI_STAT(...) __VA_ARGS__
+#else
+#define AI_STAT(...)
+#endif
+
+#define AI_PV_MAX 16
+#define AI_HIST_BUCKETS 32
+
+enum AiPhase
+{
+    AI_PHASE_WIN,     // immediate five
+    AI_PHASE_BLOCK,   // stops the opponent's five
+    AI_PHASE_BOOK,    // opening book
+    AI_PHASE_ONLY,    // single candidate
+    AI_PHASE_THREAT,  // VCF / VCT solver
+    AI_PHASE_NEGAMAX, // iterative deepening
+    AI_PHASE_COUNT
+};
+
+// get_ai_stats' layout; keep in step with AiStats in app.py.
+struct AiStats
+{
+    long long nodes;        // every search thread, threat search included
+    long long threat_nodes;
+    long long tt_probes;
+    long long tt_hits;
+    long long cutoffs;      // beta cutoffs in negamax
+    long long phase_us[AI_PHASE_COUNT];
+    long long total_us;
+    int phase;              // AiPhase that chose the move, -1 before any search
+    int depth;
+    int threads;
+    int pv_len;
+    int pv[AI_PV_MAX];      // r * BOARD_SIZE + c, the chosen move first
+};
+
+#ifdef AI_STATS
+// Bucket i counts searches of [2^i, 2^(i+1)) microseconds; bucket 0 also
+// takes anything shorter and the last one anything longer.
+std::atomic<unsigned long long> ai_latency_hist[AI_HIST_BUCKETS];
+#endif
+
+struct TransTable;
+struct AI_Board;
+
 struct GameRoom
 {
-    Player players[MAX_PLAYERS];
+    PlayerTable *players = nullptr; // replaced only by create, see Players
     Stone stones[MAX_STONES];
     int stone_count;
     int can_place_color = 1;
+    uint8_t grid[BOARD_SIZE * BOARD_SIZE]; // colour at r * BOARD_SIZE + c, 0 empty
+    std::atomic<AI_Board *> ai{nullptr};   // same position for the AI, built on first search
+    long long version = 0;
+    RoomChange log[ROOM_LOG_SIZE]; // change v at log[v % ROOM_LOG_SIZE]
+    TransTable *tt = nullptr; // AI search memory, kept across turns
+    int searches = 0;         // searches holding tt (guarded by ai_mutex)
+    std::atomic<long long> ponder_ticket{0}; // running ponder job, 0 if none
+    long long id = 0;
+    long long epoch = 0; // tells this room apart from earlier ones with its id
+    int slot = 0;
+    std::atomic<bool> live{false}; // registered; a destroyed room waits for its searches
+    int next_free = -1; // free list link
+    std::mutex lock;              // serialises writers of the fields above
+    std::atomic<unsigned> seq{0}; // seqlock; odd while a writer is active
+    std::atomic<bool> dirty{false}; // cursor changes not yet handed to a tick
+    AI_STAT(AiStats ai_stats;)      // last finished search (guarded by lock)
+};
+
+// --- Room concurrency ----------------------------------------------------
+// Writers of a room's players, stones and turn hold its mutex and bump seq
+// before and after the change. Readers never lock: they copy what they
+// need and retry if seq was odd or moved meanwhile. Rooms share nothing,
+// so different rooms never wait on each other.
+//
+// Slots are reused, so a room pointer found by id may belong to another
+// room by the time it is locked or read. Writers and readers that looked a
+// room up by id pass that id and give up if the slot no longer holds it.
+//
+// Shard commands (apply_command) also carry the epoch the room had when
+// they were queued, so those left over from a destroyed room skip a new
+// room that took its id.
+thread_local long long command_epoch = 0; // 0: not applying a command
+
+struct RoomWrite
+{
+    GameRoom *room;
+    std::lock_guard<std::mutex> guard;
+    bool valid = true; // the slot still holds the room that was looked up
+
+    explicit RoomWrite(GameRoom *r) : room(r), guard(r->lock)
+    {
+        room->seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    RoomWrite(GameRoom *r, long long id) : RoomWrite(r)
+    {
+        valid = room->live.load(std::memory_order_acquire) && room->id == id &&
+                (!command_epoch || room->epoch == command_epoch);
+    }
+    ~RoomWrite() { room->seq.fetch_add(1, std::memory_order_release); }
+};
+
+// Records a change. Caller holds a RoomWrite.
+void log_change(GameRoom *room, int kind, int player_id = 0)
+{
+    RoomChange &e = room->log[++room->version % ROOM_LOG_SIZE];
+    e.kind = kind;
+    e.player_id = player_id;
+    e.stones_before = room->stone_count;
+}
+
+// --- Broadcast batching --------------------------------------------------
+// Cursor changes only mark their room dirty. next_tick hands each dirty
+// room out once per tick, so the caller sends one merged update per room
+// per tick however many moves happened. Stones and resets are not batched:
+// the caller flushes those right away, or, when they were submitted to a
+// room shard, the shard marks the room urgent and the tick comes early.
+struct TickState
+{
+    std::mutex mutex;
+    std::condition_variable wake; // signalled when urgent is set
+    std::vector<long long> dirty; // room ids in the order they got dirty
+    int64_t interval_us = 1000000 / 30;
+    int64_t next_us = 0;
+    bool backlog = false; // last tick could not hand out every room
+    bool urgent = false;  // a dirty room should not wait for the tick
+};
+
+TickState ticks;
+
+void mark_dirty(GameRoom *room)
+{
+    if (room->dirty.exchange(true, std::memory_order_acq_rel))
+        return;
+    std::lock_guard<std::mutex> lock(ticks.mutex);
+    ticks.dirty.push_back(room->id);
+}
+
+// mark_dirty for a stone or reset: the waiting next_tick returns at once.
+void mark_urgent(GameRoom *room)
+{
+    bool was_dirty = room->dirty.exchange(true, std::memory_order_acq_rel);
+    std::lock_guard<std::mutex> lock(ticks.mutex);
+    if (!was_dirty)
+        ticks.dirty.push_back(room->id);
+    ticks.urgent = true;
+    ticks.wake.notify_one();
+}
+
+// Runs copy() until it has seen a consistent room; copy must only write
+// its own buffers and tolerate torn values on the attempts that are thrown
+// away. False, without a copy, if the slot no longer holds room `id`.
+template <typename F>
+bool read_room(const GameRoom *room, long long id, F copy)
+{
+    for (;;)
+    {
+        unsigned s = room->seq.load(std::memory_order_acquire);
+        if (s & 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (!room->live.load(std::memory_order_acquire) || room->id != id)
+            return false;
+        copy();
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (room->seq.load(std::memory_order_relaxed) == s)
+            return true;
+    }
+}
+
+void clear_board(GameRoom *room);
+
+// --- Journal -------------------------------------------------------------
+// With open_journal, every change to a room is appended to a write-ahead
+// journal: callers only copy a fixed-size record into a memory batch while
+// they hold the room's RoomWrite, and a background thread writes the batch
+// and fsyncs it (group commit) every journal.sync_ms. Batches are striped
+// by room id, so writers in different rooms rarely share a lock and a
+// room's records stay in order; only the journal thread takes the global
+// mutex. Cursor moves are not journaled, only joins: cursors come back
+// where the last snapshot saw them. The journal is split
+// into numbered segments; a snapshot records the segment it starts from,
+// and recovery replays that segment onwards on top of it. A record carries
+// the room's epoch and its version after the change, so replay skips what
+// the snapshot already holds and anything meant for an earlier room with
+// the same id.
+enum JournalKind
+{
+    JR_CREATE,
+    JR_DESTROY,
+    JR_MOVE,   // player joined; a, b: dx, dy of the joining move
+    JR_REMOVE,
+    JR_PLACE,  // a, b: r, c; color
+    JR_RESET
+};
+
+struct JournalRecord
+{
+    long long room_id;
+    long long epoch;
+    long long version; // room version after the change
+    uint8_t kind;
+    int8_t a, b;
+    uint8_t color;
+    int32_t player_id;
+    uint32_t check; // journal_check of the bytes above; catches torn tails
+    uint32_t pad;
+};
+
+inline uint32_t journal_check(const JournalRecord &rec)
+{
+    const uint8_t *p = (const uint8_t *)&rec;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < offsetof(JournalRecord, check); i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+#define JOURNAL_STRIPES 64
+
+struct alignas(64) JournalStripe
+{
+    std::mutex mutex;
+    std::vector<JournalRecord> pending;
+};
+
+struct Journal
+{
+    std::atomic<bool> active{false};
+    std::mutex mutex; // segment and the flush counters; journal thread and sync_journal
+    std::condition_variable wake;
+    JournalStripe stripes[JOURNAL_STRIPES];
+    long long segment = 0; // records pending in the stripes go to this segment
+    int sync_ms = 10;
+    int snapshot_sec = 60;
+    long long flush_wanted = 0; // sync_journal calls so far
+    long long flushed = 0;      // of those, made durable
+    std::condition_variable flushed_cv;
+    std::string dir;
+    int fd = -1; // open segment; journal thread only
+};
+
+// Never destroyed: the journal thread keeps running during static teardown.
+Journal &journal = *new Journal();
+std::atomic<long long> next_room_epoch{1};
+
+// Queues a record for the room's latest change. Caller holds a RoomWrite
+// (or the registry lock for JR_CREATE and JR_DESTROY).
+void journal_room(const GameRoom *room, int kind, int player_id = 0, int a = 0, int b = 0, int color = 0)
+{
+    if (!journal.active.load(std::memory_order_relaxed))
+        return;
+    JournalRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.room_id = room->id;
+    rec.epoch = room->epoch;
+    rec.version = room->version;
+    rec.kind = (uint8_t)kind;
+    rec.a = (int8_t)a;
+    rec.b = (int8_t)b;
+    rec.color = (uint8_t)color;
+    rec.player_id = player_id;
+    rec.check = journal_check(rec);
+    JournalStripe &stripe = journal.stripes[(((uint64_t)rec.room_id * 0x9E3779B97F4A7C15ull) >> 32) % JOURNAL_STRIPES];
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    stripe.pending.push_back(rec);
+}
+
+// --- Room registry -------------------------------------------------------
+// Rooms are allocated in slabs that are never freed, so a GameRoom* (or its
+// slot number) stays valid while the room is live. Ids map to slots through
+// an open-addressing table with linear probing and backward-shift deletion,
+// doubled whenever it gets half full. Destroyed slots go on a free list.
+#define ROOM_SLAB 1024
+#define MAX_ROOM_SLABS 1024 // capacity ROOM_SLAB * MAX_ROOM_SLABS rooms
+
+struct RoomIndexEntry
+{
+    long long id;
+    int slot; // -1: empty
+};
+
+struct RoomRegistry
+{
+    std::shared_mutex mutex; // index, free list and slab list
+    GameRoom *slabs[MAX_ROOM_SLABS] = {};
+    int slots = 0; // slots handed out so far
+    int free_head = -1;
+    RoomIndexEntry *index = nullptr;
+    size_t mask = 0;
+    size_t used = 0;
+
+    GameRoom *at(int slot) const { return &slabs[slot / ROOM_SLAB][slot % ROOM_SLAB]; }
+
+    static size_t hash(long long id)
+    {
+        uint64_t z = (uint64_t)id + 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return (size_t)(z ^ (z >> 31));
+    }
+
+    // Caller holds mutex. Index position of id, or of the empty entry
+    // where it would go.
+    size_t probe(long long id) const
+    {
+        size_t i = hash(id) & mask;
+        while (index[i].slot != -1 && index[i].id != id)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void grow()
+    {
+        size_t cap = index ? (mask + 1) * 2 : 1024;
+        RoomIndexEntry *old = index;
+        size_t old_cap = index ? mask + 1 : 0;
+        index = new RoomIndexEntry[cap];
+        for (size_t i = 0; i < cap; i++)
+            index[i].slot = -1;
+        mask = cap - 1;
+        for (size_t i = 0; i < old_cap; i++)
+            if (old[i].slot != -1)
+                index[probe(old[i].id)] = old[i];
+        delete[] old;
+    }
+
+    GameRoom *find(long long id)
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (!index)
+            return nullptr;
+        const RoomIndexEntry &e = index[probe(id)];
+        return e.slot != -1 ? at(e.slot) : nullptr;
+    }
+
+    // 1 created, 0 already there, -1 out of rooms.
+    int create(long long id)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if ((used + 1) * 2 > mask + 1)
+            grow();
+        size_t i = probe(id);
+        if (index[i].slot != -1)
+            return 0;
+        int slot = free_head;
+        if (slot != -1)
+            free_head = at(slot)->next_free;
+        else
+        {
+            if (slots == ROOM_SLAB * MAX_ROOM_SLABS)
+                return -1;
+            slot = slots++;
+            if (slot % ROOM_SLAB == 0)
+                slabs[slot / ROOM_SLAB] = new GameRoom[ROOM_SLAB]();
+        }
+        GameRoom *room = at(slot);
+        {
+            RoomWrite w(room);
+            clear_board(room);
+            if (!room->players || room->players->allocated < player_capacity)
+            {
+                if (room->players)
+                    retired_player_tables.push_back(room->players);
+                room->players = new PlayerTable(player_capacity);
+            }
+            room->players->reset(player_capacity);
+            room->id = id;
+            room->epoch = next_room_epoch.fetch_add(1, std::memory_order_relaxed);
+            room->version = 0;
+            // A room destroyed while dirty never had its flag cleared by next_tick.
+            room->dirty.store(false, std::memory_order_relaxed);
+            AI_STAT(memset(&room->ai_stats, 0, sizeof(room->ai_stats)); room->ai_stats.phase = -1;)
+        }
+        room->ponder_ticket.store(0, std::memory_order_relaxed);
+        room->slot = slot;
+        room->live = true;
+        index[i].id = id;
+        index[i].slot = slot;
+        used++;
+        journal_room(room, JR_CREATE);
+        return 1;
+    }
+
+    // Unlinks id so lookups no longer find it; returns its slot or -1.
+    // The slot is reused only after release().
+    int remove(long long id)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        if (!index)
+            return -1;
+        size_t i = probe(id);
+        int slot = index[i].slot;
+        if (slot == -1)
+            return -1;
+        // Backward-shift the rest of the cluster into the hole.
+        for (size_t j = (i + 1) & mask; index[j].slot != -1; j = (j + 1) & mask)
+        {
+            size_t home = hash(index[j].id) & mask;
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                index[i] = index[j];
+                i = j;
+            }
+        }
+        index[i].slot = -1;
+        used--;
+        journal_room(at(slot), JR_DESTROY);
+        return slot;
+    }
+
+    void release(int slot)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        at(slot)->next_free = free_head;
+        free_head = slot;
+    }
 };
 
-GameRoom rooms[MAX_ROOMS];
+RoomRegistry room_registry;
 
 // --- AI Logic (Ported) --------------------------------------------------
 int dx[4] = {1, 0, 1, 1};
@@ -40,356 +630,2461 @@ bool inside(int x, int y)
     return x >= 1 && x < BOARD_SIZE && y >= 1 && y < BOARD_SIZE;
 }
 
-int count_dir(const int g[BOARD_SIZE][BOARD_SIZE], int x, int y, int d, int p)
+// --- Bitboard tables ----------------------------------------------------
+// Every cell lies on four lines, one per direction of dx/dy:
+//   d=0 columns (15), d=1 rows (15), d=2 diagonals (29), d=3 anti-diagonals (29).
+// A line is stored as one word per colour, bit i = i-th cell walking along
+// (dx[d], dy[d]), so runs through a cell become shifts and masks.
+#define CELLS (BOARD_SIZE * BOARD_SIZE)
+#define NUM_LINES (BOARD_SIZE * 6 - 2)
+#define ROW_LINE(x) (BOARD_SIZE + (x))
+
+typedef uint32_t LineBits;
+
+struct LineSlot
+{
+    uint8_t line;
+    uint8_t pos;
+};
+
+struct LineTables
 {
-    int cnt = 0;
-    for (int s = 1; s < 5; s++)
+    LineSlot slot[CELLS][4];
+    uint8_t len[NUM_LINES];
+    LineBits full[NUM_LINES];
+    uint8_t nb_count[CELLS];  // cells within two steps (5x5, self included)
+    uint8_t nb[CELLS][25];
+    uint8_t cell_at[NUM_LINES][BOARD_SIZE];
+
+    LineTables()
     {
-        int nx = x + dx[d] * s, ny = y + dy[d] * s;
-        if (!inside(nx, ny) || g[nx][ny] != p)
-            break;
-        cnt++;
+        for (int x = 0; x < BOARD_SIZE; x++)
+            for (int y = 0; y < BOARD_SIZE; y++)
+            {
+                int m = x * BOARD_SIZE + y;
+                int k = x - y + BOARD_SIZE - 1, a = x + y;
+                slot[m][0] = {(uint8_t)y, (uint8_t)x};
+                slot[m][1] = {(uint8_t)(BOARD_SIZE + x), (uint8_t)y};
+                slot[m][2] = {(uint8_t)(2 * BOARD_SIZE + k), (uint8_t)std::min(x, y)};
+                slot[m][3] = {(uint8_t)(4 * BOARD_SIZE - 1 + a), (uint8_t)(x - std::max(0, a - (BOARD_SIZE - 1)))};
+                for (int d = 0; d < 4; d++)
+                    cell_at[slot[m][d].line][slot[m][d].pos] = (uint8_t)m;
+            }
+        for (int l = 0; l < NUM_LINES; l++)
+        {
+            int n = BOARD_SIZE;
+            if (l >= 2 * BOARD_SIZE)
+            {
+                int k = (l - 2 * BOARD_SIZE) % (2 * BOARD_SIZE - 1);
+                n = BOARD_SIZE - std::abs(k - (BOARD_SIZE - 1));
+            }
+            len[l] = (uint8_t)n;
+            full[l] = (1u << n) - 1;
+        }
+        for (int m = 0; m < CELLS; m++)
+        {
+            int x = m / BOARD_SIZE, y = m % BOARD_SIZE, n = 0;
+            for (int i = std::max(0, x - 2); i <= std::min(BOARD_SIZE - 1, x + 2); i++)
+                for (int j = std::max(0, y - 2); j <= std::min(BOARD_SIZE - 1, y + 2); j++)
+                    nb[m][n++] = (uint8_t)(i * BOARD_SIZE + j);
+            nb_count[m] = (uint8_t)n;
+        }
     }
-    return cnt;
+};
+
+static const LineTables LT;
+
+// Consecutive set bits of w directly above / below bit `pos` (pos itself excluded).
+static inline int run_up(LineBits w, int pos)
+{
+    return __builtin_ctz(~(w >> (pos + 1)));
 }
 
-bool open_end(const int g[BOARD_SIZE][BOARD_SIZE], int x, int y, int d, int len)
+static inline int run_down(LineBits w, int pos)
 {
-    int nx = x + dx[d] * (len + 1), ny = y + dy[d] * (len + 1);
-    return inside(nx, ny) && g[nx][ny] == 0;
+    LineBits gaps = ~w & ((1u << pos) - 1);
+    return gaps ? pos - 1 - (31 - __builtin_clz(gaps)) : pos;
 }
 
-bool win_after(const int g[BOARD_SIZE][BOARD_SIZE], int x, int y, int p)
+// --- Line patterns --------------------------------------------------------
+// Each line is read through six-cell windows, two bits per cell: own stones
+// in the low six bits, cells blocked for the owner (opponent stones or the
+// board edge) in the high six. PatternTable maps a window to the strongest
+// shape it shows; a line is classed by its strongest window.
+enum Pattern
+{
+    P_NONE,
+    P_TWO,         // _XX__ style: two stones with room for an open three
+    P_THREE,       // three in five cells, one side closed
+    P_SPLIT_THREE, // _X_XX_
+    P_OPEN_THREE,  // _XXX__
+    P_FOUR,        // four in five cells: one cell completes five
+    P_OPEN_FOUR,   // _XXXX_
+    P_FIVE,
+    P_COUNT
+};
+
+#define WIN_SCORE 1000000
+
+static const int pattern_score[P_COUNT] = {0, 10, 50, 400, 500, 800, WIN_SCORE / 2, WIN_SCORE};
+
+struct PatternTable
 {
-    for (int d = 0; d < 4; d++)
+    uint8_t cls[1 << 12];
+
+    PatternTable()
     {
-        int l = 0;
-        for (int s = 1; s < 5; s++)
+        for (int idx = 0; idx < (1 << 12); idx++)
         {
-            int nx = x + dx[d] * s, ny = y + dy[d] * s;
-            if (!inside(nx, ny) || g[nx][ny] != p)
-                break;
-            l++;
+            int own = idx & 63, blk = idx >> 6;
+            cls[idx] = (uint8_t)((own & blk) ? (int)P_NONE : classify(own, blk));
         }
-        int r = 0;
-        for (int s = 1; s < 5; s++)
+    }
+
+    static int classify(int own, int blk)
+    {
+        int best = P_NONE;
+        for (int i = 0; i < 2; i++)
         {
-            int nx = x - dx[d] * s, ny = y - dy[d] * s;
-            if (!inside(nx, ny) || g[nx][ny] != p)
-                break;
-            r++;
+            int o = own >> i & 31, b = blk >> i & 31;
+            if (o == 31)
+                return P_FIVE;
+            if (!b && __builtin_popcount(o) == 4)
+                best = std::max(best, (int)P_FOUR);
+            else if (!b && __builtin_popcount(o) == 3)
+                best = std::max(best, (int)P_THREE);
         }
-        if (l + r + 1 >= 5)
+        if ((own & 33) || (blk & 33) || (blk & 30))
+            return best;
+        // Both ends empty, nothing blocked inside: shape of the middle four.
+        int mid = own >> 1 & 15;
+        int n = __builtin_popcount(mid);
+        if (n == 4)
+            return P_OPEN_FOUR;
+        if (n == 3)
+            return std::max(best, (mid == 7 || mid == 14) ? (int)P_OPEN_THREE : (int)P_SPLIT_THREE);
+        if (n == 2)
+            return std::max(best, (int)P_TWO);
+        return best;
+    }
+};
+
+static const PatternTable PT;
+
+// Strongest pattern of `own` on a line of `len` cells; both edges count as blocked.
+static int line_pattern(LineBits own, LineBits opp, int len)
+{
+    if (len < 5 || !own)
+        return P_NONE;
+    uint32_t o = own << 1, b = (opp << 1) | 1u | (~0u << (len + 1));
+    // Only windows overlapping an own stone can show a pattern.
+    int lo = std::max(0, __builtin_ctz(o) - 5), hi = std::min(len - 4, 31 - __builtin_clz(o));
+    int best = P_NONE;
+    for (int i = lo; i <= hi; i++)
+        best = std::max(best, (int)PT.cls[(o >> i & 63) | (b >> i & 63) << 6]);
+    return best;
+}
+
+// Empty cells that give `own` four stones inside an unblocked five-cell window.
+static LineBits four_cells(LineBits own, LineBits opp, int len)
+{
+    LineBits res = 0;
+    for (int i = 0; i + 5 <= len; i++)
+    {
+        LineBits w = 31u << i;
+        if (!(opp & w) && __builtin_popcount(own & w) == 3)
+            res |= w & ~own;
+    }
+    return res;
+}
+
+// Empty cells that give `own` an open four (_XXXX_ inside the board).
+// `span`, if given, collects the empty cells of every such window.
+static LineBits straight_four_cells(LineBits own, LineBits opp, int len, LineBits *span = nullptr)
+{
+    LineBits res = 0;
+    for (int i = 0; i + 6 <= len; i++)
+    {
+        LineBits w = 63u << i, mid = 30u << i;
+        if ((opp & w) || (own & w & ~mid) || __builtin_popcount(own & mid) != 3)
+            continue;
+        res |= mid & ~own;
+        if (span)
+            *span |= w & ~own;
+    }
+    return res;
+}
+
+// Empty cells that complete five for `own`.
+static LineBits five_cells_line(LineBits own, LineBits opp, int len)
+{
+    LineBits res = 0;
+    for (int i = 0; i + 5 <= len; i++)
+    {
+        LineBits w = 31u << i;
+        if (!(opp & w) && __builtin_popcount(own & w) == 4)
+            res |= w & ~own;
+    }
+    return res;
+}
+
+// Empty cells that give `own` an open three: three stones in the middle of
+// an unblocked six-cell window with both ends empty.
+static LineBits three_cells(LineBits own, LineBits opp, int len)
+{
+    LineBits res = 0;
+    for (int i = 0; i + 6 <= len; i++)
+    {
+        LineBits w = 63u << i, mid = 30u << i;
+        if (!(opp & w) && !(own & w & ~mid) && __builtin_popcount(own & mid) == 2)
+            res |= mid & ~own;
+    }
+    return res;
+}
+
+static int64_t now_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// --- Zobrist keys / transposition table --------------------------------
+struct ZobristKeys
+{
+    uint64_t stone[2][CELLS];
+    uint64_t side;   // xor'ed in while White (-1) is to move
+    uint64_t vcf, vct; // keep threat solver entries apart from negamax ones
+
+    ZobristKeys()
+    {
+        uint64_t s = 0x2545F4914F6CDD1Dull; // fixed seed: keys must agree across rooms and runs
+        for (int c = 0; c < 2; c++)
+            for (int m = 0; m < CELLS; m++)
+                stone[c][m] = splitmix(s);
+        side = splitmix(s);
+        vcf = splitmix(s);
+        vct = splitmix(s);
+    }
+
+    static uint64_t splitmix(uint64_t &s)
+    {
+        uint64_t z = (s += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+static const ZobristKeys ZK;
+
+enum TTBound
+{
+    TT_NONE = 0,
+    TT_UPPER = 1,
+    TT_LOWER = 2,
+    TT_EXACT = 3
+};
+
+struct TTHit
+{
+    int score;
+    int move; // -1 if none
+    int depth;
+    int bound;
+};
+
+// An entry is two relaxed atomics; `check` holds key ^ data so a torn
+// write from a concurrent store simply fails verification on probe.
+struct TTEntry
+{
+    std::atomic<uint64_t> check;
+    std::atomic<uint64_t> data;
+};
+
+#define TT_BUCKET_ENTRIES 4
+
+struct alignas(64) TTBucket
+{
+    TTEntry e[TT_BUCKET_ENTRIES];
+};
+
+// data layout: score:32 | move:8 | depth:8 | bound:2 | generation:6
+struct TransTable
+{
+    TTBucket *buckets = nullptr;
+    uint64_t mask = 0;
+    size_t bytes = 0;
+    std::atomic<int> generation{0};
+
+    ~TransTable() { delete[] buckets; }
+
+    void resize(size_t budget)
+    {
+        size_t n = 1;
+        while (n * 2 * sizeof(TTBucket) <= budget)
+            n *= 2;
+        delete[] buckets;
+        buckets = new TTBucket[n];
+        mask = n - 1;
+        bytes = budget;
+        clear();
+    }
+
+    void clear()
+    {
+        for (uint64_t i = 0; i <= mask; i++)
+            for (TTEntry &e : buckets[i].e)
+            {
+                e.check.store(0, std::memory_order_relaxed);
+                e.data.store(0, std::memory_order_relaxed);
+            }
+    }
+
+    void new_search() { generation.store((generation.load(std::memory_order_relaxed) + 1) & 63, std::memory_order_relaxed); }
+
+    static uint64_t pack(int depth, int bound, int score, int move, int gen)
+    {
+        return (uint64_t)(uint32_t)score | (uint64_t)(uint8_t)(move < 0 ? 255 : move) << 32 |
+               (uint64_t)(uint8_t)depth << 40 | (uint64_t)bound << 48 | (uint64_t)gen << 50;
+    }
+
+    bool probe(uint64_t key, TTHit &hit) const
+    {
+        const TTBucket &b = buckets[key & mask];
+        for (const TTEntry &e : b.e)
+        {
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if ((e.check.load(std::memory_order_relaxed) ^ data) != key || data == 0)
+                continue;
+            hit.score = (int32_t)(uint32_t)data;
+            int move = (int)(data >> 32 & 0xFF);
+            hit.move = move == 255 ? -1 : move;
+            hit.depth = (int)(data >> 40 & 0xFF);
+            hit.bound = (int)(data >> 48 & 3);
             return true;
+        }
+        return false;
+    }
+
+    void store(uint64_t key, int depth, int bound, int score, int move)
+    {
+        TTBucket &b = buckets[key & mask];
+        TTEntry *victim = nullptr;
+        int victim_value = 1 << 30;
+        for (TTEntry &e : b.e)
+        {
+            uint64_t data = e.data.load(std::memory_order_relaxed);
+            if (data == 0 || (e.check.load(std::memory_order_relaxed) ^ data) == key)
+            {
+                victim = &e;
+                break;
+            }
+            // Prefer evicting shallow entries and ones left over from older searches.
+            int age = (generation.load(std::memory_order_relaxed) - (int)(data >> 50 & 63)) & 63;
+            int value = (int)(data >> 40 & 0xFF) - 4 * age;
+            if (value < victim_value)
+            {
+                victim_value = value;
+                victim = &e;
+            }
+        }
+        uint64_t data = pack(depth, bound, score, move, generation.load(std::memory_order_relaxed));
+        victim->check.store(key ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+    }
+};
+
+// Per-room table size; rooms pick up a changed budget on their next search.
+size_t tt_budget_bytes = (size_t)4 << 20;
+
+// Threat/killer/history ordering in negamax; off leaves only the hash move first.
+bool ai_move_ordering = true;
+
+// Fixed-capacity move buffer; lives on the stack of the searching frame.
+// `score` is scratch space for move ordering.
+struct MoveList
+{
+    int n = 0;
+    int m[CELLS];
+    int score[CELLS];
+
+    void push(int move) { m[n++] = move; }
+    const int *begin() const { return m; }
+    const int *end() const { return m + n; }
+};
+
+// Live view of a running search for other threads.
+struct SearchProgress
+{
+    std::atomic<int> depth{0};
+    std::atomic<long long> nodes{0};
+};
+
+struct AI_Board
+{
+    LineBits bits[2][NUM_LINES]; // [0] Black (+1), [1] White (-1)
+    uint64_t hash;               // Zobrist key of the stones only
+    uint8_t near[CELLS];         // stones within two steps of each cell
+    LineBits cand[BOARD_SIZE];   // per row: empty cells with near > 0
+    uint8_t pat[2][NUM_LINES];   // line_pattern of each line per colour
+    uint8_t pat_count[2][P_COUNT];
+    int stones;
+    int turn;
+    TransTable *tt = nullptr;
+
+    // Search limits: deadline_us == 0 means unbounded; `abort` lets another
+    // thread stop this search.
+    uint64_t nodes = 0;
+    int64_t deadline_us = 0;
+    const std::atomic<bool> *abort = nullptr;
+    bool stopped = false;
+    SearchProgress *progress = nullptr;
+    int threads = 0; // search threads, 0 = ai_threads
+
+    // Move ordering state, per search thread.
+    int ply = 0;
+    int killers[AI_MAX_PLY][2];
+    int history[2][CELLS];
+
+#ifdef AI_STATS
+    AiStats stat;
+    int64_t stat_start_us = 0, stat_lap_us = 0;
+
+    void stat_begin()
+    {
+        memset(&stat, 0, sizeof(stat));
+        stat.phase = -1;
+        stat_start_us = stat_lap_us = now_us();
+    }
+
+    // Charges the time since the last lap to `phase`, which chose the move
+    // if m != -1 and no earlier phase did.
+    void stat_lap(int phase, int m)
+    {
+        int64_t t = now_us();
+        stat.phase_us[phase] += t - stat_lap_us;
+        stat_lap_us = t;
+        if (m != -1 && stat.phase == -1)
+            stat.phase = phase;
+    }
+#endif
+
+    static int side(int p) { return p == 1 ? 0 : 1; }
+
+    // Counts a node and polls the clock and abort flag every 1024 nodes.
+    bool tick()
+    {
+        if ((++nodes & 1023) == 0)
+        {
+            if ((deadline_us && now_us() >= deadline_us) || (abort && abort->load(std::memory_order_relaxed)))
+                stopped = true;
+        }
+        return stopped;
+    }
+
+    void clear()
+    {
+        memset(bits, 0, sizeof(bits));
+        memset(near, 0, sizeof(near));
+        memset(cand, 0, sizeof(cand));
+        memset(pat, 0, sizeof(pat));
+        memset(pat_count, 0, sizeof(pat_count));
+        pat_count[0][P_NONE] = pat_count[1][P_NONE] = NUM_LINES;
+        hash = 0;
+        stones = 0;
+        memset(killers, -1, sizeof(killers));
+        memset(history, 0, sizeof(history));
+    }
+
+    uint64_t key() const { return turn == 1 ? hash : hash ^ ZK.side; }
+
+    void from_room(GameRoom *room);
+
+    // Takes over another board's stones (and everything derived from them).
+    void copy_position(const AI_Board &o)
+    {
+        memcpy(bits, o.bits, sizeof(bits));
+        hash = o.hash;
+        memcpy(near, o.near, sizeof(near));
+        memcpy(cand, o.cand, sizeof(cand));
+        memcpy(pat, o.pat, sizeof(pat));
+        memcpy(pat_count, o.pat_count, sizeof(pat_count));
+        stones = o.stones;
+    }
+
+    void play(int m, int p)
+    {
+        LineBits *own = bits[side(p)];
+        for (int d = 0; d < 4; d++)
+            own[LT.slot[m][d].line] |= 1u << LT.slot[m][d].pos;
+        hash ^= ZK.stone[side(p)][m];
+        stones++;
+        for (int i = 0; i < LT.nb_count[m]; i++)
+        {
+            int n = LT.nb[m][i];
+            if (near[n]++ == 0)
+                cand[n / BOARD_SIZE] |= 1u << (n % BOARD_SIZE);
+        }
+        cand[m / BOARD_SIZE] &= ~(1u << (m % BOARD_SIZE));
+        rescore(m);
+    }
+
+    void undo(int m, int p)
+    {
+        LineBits *own = bits[side(p)];
+        for (int d = 0; d < 4; d++)
+            own[LT.slot[m][d].line] &= ~(1u << LT.slot[m][d].pos);
+        hash ^= ZK.stone[side(p)][m];
+        stones--;
+        for (int i = 0; i < LT.nb_count[m]; i++)
+        {
+            int n = LT.nb[m][i];
+            if (--near[n] == 0)
+                cand[n / BOARD_SIZE] &= ~(1u << (n % BOARD_SIZE));
+        }
+        if (near[m])
+            cand[m / BOARD_SIZE] |= 1u << (m % BOARD_SIZE);
+        rescore(m);
+    }
+
+    // Re-derives the patterns of the four lines through m for both colours.
+    void rescore(int m)
+    {
+        for (int d = 0; d < 4; d++)
+        {
+            int l = LT.slot[m][d].line;
+            for (int c = 0; c < 2; c++)
+            {
+                int np = line_pattern(bits[c][l], bits[c ^ 1][l], LT.len[l]);
+                pat_count[c][pat[c][l]]--;
+                pat_count[c][np]++;
+                pat[c][l] = (uint8_t)np;
+            }
+        }
+    }
+
+    int at(int m) const
+    {
+        const LineSlot &s = LT.slot[m][1];
+        if (bits[0][s.line] >> s.pos & 1)
+            return 1;
+        if (bits[1][s.line] >> s.pos & 1)
+            return -1;
+        return 0;
+    }
+
+    bool win_at(int m) const
+    {
+        int p = at(m);
+        if (p == 0)
+            return false;
+        const LineBits *own = bits[side(p)];
+        for (int d = 0; d < 4; d++)
+        {
+            const LineSlot &s = LT.slot[m][d];
+            LineBits w = own[s.line];
+            if (run_up(w, s.pos) + run_down(w, s.pos) + 1 >= 5)
+                return true;
+        }
+        return false;
+    }
+
+    // Cells where colour index c completes five, deduplicated; returns the count.
+    int five_cells(int c, int *out) const
+    {
+        if (!pat_count[c][P_FOUR] && !pat_count[c][P_OPEN_FOUR])
+            return 0;
+        int n = 0;
+        for (int l = 0; l < NUM_LINES; l++)
+        {
+            if (pat[c][l] != P_FOUR && pat[c][l] != P_OPEN_FOUR)
+                continue;
+            for (LineBits f = five_cells_line(bits[c][l], bits[c ^ 1][l], LT.len[l]); f; f &= f - 1)
+            {
+                int m = LT.cell_at[l][__builtin_ctz(f)];
+                if (std::find(out, out + n, m) == out + n)
+                    out[n++] = m;
+            }
+        }
+        return n;
+    }
+
+    // Empty cells within two steps of a stone, row-major; the centre on an
+    // empty board.
+    void candidates(MoveList &ml) const
+    {
+        ml.n = 0;
+        if (stones == 0)
+        {
+            ml.push(7 * BOARD_SIZE + 7);
+            return;
+        }
+        for (int x = 0; x < BOARD_SIZE; x++)
+            for (LineBits free = cand[x]; free; free &= free - 1)
+                ml.push(x * BOARD_SIZE + __builtin_ctz(free));
+    }
+
+    // Static score from the side to move's point of view, read off the
+    // incrementally maintained line pattern counts.
+    int evaluate() const
+    {
+        const uint8_t *own = pat_count[side(turn)], *opp = pat_count[side(-turn)];
+        if (own[P_FIVE])
+            return WIN_SCORE;
+        if (opp[P_FIVE])
+            return -WIN_SCORE;
+        // Whoever moves completes a four first; two opposing fours cannot both be stopped.
+        if (own[P_FOUR] || own[P_OPEN_FOUR])
+            return WIN_SCORE - 1;
+        if (opp[P_OPEN_FOUR] || opp[P_FOUR] > 1)
+            return -(WIN_SCORE - 2);
+        int score = 0;
+        for (int k = P_TWO; k <= P_FOUR; k++)
+            score += pattern_score[k] * (own[k] - opp[k]);
+        return score;
+    }
+
+    // Sorts ml best-first: hash move, own five, block five, own four, block
+    // four, own open three, block open three, the two killers of this ply,
+    // then the history score.
+    void order_moves(MoveList &ml, int hash_move) const
+    {
+        enum
+        {
+            O_THREE_BLOCK,
+            O_THREE,
+            O_FOUR_BLOCK,
+            O_FOUR,
+            O_FIVE_BLOCK,
+            O_FIVE,
+            O_CLASSES
+        };
+        LineBits mask[O_CLASSES][BOARD_SIZE] = {};
+        const int me = side(turn);
+        for (int c = 0; c < 2; c++)
+            for (int l = 0; l < NUM_LINES; l++)
+            {
+                int pt = pat[c][l];
+                if (pt < P_TWO || pt == P_FIVE)
+                    continue;
+                LineBits own = bits[c][l], opp = bits[c ^ 1][l];
+                int len = LT.len[l], blk = c == me ? 0 : -1;
+                LineBits cls[3] = {pt >= P_SPLIT_THREE ? 0 : three_cells(own, opp, len),
+                                   pt >= P_THREE && pt < P_FOUR ? four_cells(own, opp, len) : 0,
+                                   pt >= P_FOUR ? five_cells_line(own, opp, len) : 0};
+                for (int k = 0; k < 3; k++)
+                    for (LineBits f = cls[k]; f; f &= f - 1)
+                    {
+                        int m = LT.cell_at[l][__builtin_ctz(f)];
+                        mask[O_THREE + 2 * k + blk][m / BOARD_SIZE] |= 1u << (m % BOARD_SIZE);
+                    }
+            }
+        const int *killer = killers[std::min(ply, AI_MAX_PLY - 1)];
+        for (int i = 0; i < ml.n; i++)
+        {
+            int m = ml.m[i], x = m / BOARD_SIZE;
+            LineBits bit = 1u << (m % BOARD_SIZE);
+            int sc = history[me][m];
+            if (m == hash_move)
+                sc = 1 << 30;
+            else if (m == killer[0] || m == killer[1])
+                sc = (1 << 22) + (m == killer[0]);
+            for (int k = O_CLASSES - 1; k >= 0; k--)
+                if (mask[k][x] & bit)
+                {
+                    sc = std::max(sc, (1 << 23) << k);
+                    break;
+                }
+            // Insertion sort; lists are short and mostly small.
+            int j = i;
+            for (; j > 0 && ml.score[j - 1] < sc; j--)
+            {
+                ml.m[j] = ml.m[j - 1];
+                ml.score[j] = ml.score[j - 1];
+            }
+            ml.m[j] = m;
+            ml.score[j] = sc;
+        }
+    }
+
+    // Quiet moves that cut off become killers at this ply and earn history.
+    void note_cutoff(int m, int depth)
+    {
+        int *killer = killers[std::min(ply, AI_MAX_PLY - 1)];
+        if (killer[0] != m)
+        {
+            killer[1] = killer[0];
+            killer[0] = m;
+        }
+        int &h = history[side(turn)][m];
+        h = std::min(h + depth * depth, (1 << 22) - 1);
+    }
+
+    int negamax(int depth, int alpha, int beta)
+    {
+        if (tick())
+            return 0;
+        if (depth == 0)
+            return evaluate();
+        const int alpha0 = alpha;
+        const uint64_t k = key();
+        int hash_move = -1;
+        TTHit hit;
+        AI_STAT(stat.tt_probes += tt != nullptr;)
+        if (tt && tt->probe(k, hit))
+        {
+            AI_STAT(stat.tt_hits++;)
+            if (hit.move >= 0 && at(hit.move) == 0)
+                hash_move = hit.move;
+            if (hit.depth >= depth)
+            {
+                if (hit.bound == TT_EXACT)
+                    return hit.score;
+                if (hit.bound == TT_LOWER)
+                    alpha = std::max(alpha, hit.score);
+                else if (hit.bound == TT_UPPER)
+                    beta = std::min(beta, hit.score);
+                if (alpha >= beta)
+                    return hit.score;
+            }
+        }
+        int best_move = -1;
+        auto search = [&](int m) {
+            play(m, turn);
+            turn = -turn;
+            ply++;
+            int v = win_at(m) ? WIN_SCORE : -negamax(depth - 1, -beta, -alpha);
+            ply--;
+            turn = -turn;
+            undo(m, turn);
+            if (stopped)
+                return true;
+            if (v > alpha || best_move == -1)
+                best_move = m;
+            alpha = std::max(alpha, v);
+            if (alpha < beta)
+                return false;
+            AI_STAT(stat.cutoffs++;)
+            if (ai_move_ordering)
+                note_cutoff(m, depth);
+            return true;
+        };
+        bool cut = hash_move != -1 && search(hash_move);
+        MoveList ml;
+        if (!cut)
+        {
+            candidates(ml);
+            if (ai_move_ordering)
+                order_moves(ml, hash_move);
+        }
+        for (int m : ml)
+            if (m != hash_move && search(m))
+                break;
+        if (stopped)
+            return 0;
+        if (tt)
+        {
+            int bound = alpha >= beta ? TT_LOWER : alpha > alpha0 ? TT_EXACT : TT_UPPER;
+            tt->store(k, depth, bound, alpha, best_move);
+        }
+        return alpha;
+    }
+
+    // First candidate that gives p five in a row, or -1.
+    int find_five(int p)
+    {
+        MoveList ml;
+        candidates(ml);
+        for (int m : ml)
+        {
+            play(m, p);
+            bool won = win_at(m);
+            undo(m, p);
+            if (won)
+                return m;
+        }
+        return -1;
+    }
+
+    // One full-width iteration of `depth` plies (root move included).
+    // `first` is searched before the other candidates, which start at index
+    // `rotate`. Returns -1 if the search was stopped before every root move
+    // was searched.
+    int search_root(int depth, int first, int &best_val, int rotate = 0)
+    {
+        int best_move = -1;
+        best_val = -INF;
+        // Each root move only has to beat the best so far.
+        auto search = [&](int m) {
+            play(m, turn);
+            turn = -turn;
+            ply = 1;
+            int v = win_at(m) ? WIN_SCORE : -negamax(depth - 1, -INF, -best_val);
+            ply = 0;
+            turn = -turn;
+            undo(m, turn);
+            if (!stopped && v > best_val)
+            {
+                best_val = v;
+                best_move = m;
+            }
+        };
+        if (first != -1)
+            search(first);
+        MoveList ml;
+        candidates(ml);
+        if (ai_move_ordering)
+            order_moves(ml, first);
+        for (int i = 0; i < ml.n && !stopped; i++)
+        {
+            int m = ml.m[(i + rotate) % ml.n];
+            if (m != first)
+                search(m);
+        }
+        return stopped ? -1 : best_move;
+    }
+
+    int choose_move(int min_depth, int max_depth, int &depth_reached);
+};
+
+// The room's position as the AI sees it. Built from the move list on the
+// first search; place_stone and reset_game keep it current after that, so
+// later searches copy it instead of replaying every stone.
+AI_Board *room_position(GameRoom *room)
+{
+    AI_Board *b = room->ai.load(std::memory_order_acquire);
+    if (b)
+        return b;
+    std::lock_guard<std::mutex> lock(room->lock);
+    b = room->ai.load(std::memory_order_relaxed);
+    if (!b)
+    {
+        b = new AI_Board();
+        b->clear();
+        for (int i = 0; i < room->stone_count; ++i)
+        {
+            // AI 1, -1. Room 1 (Black), 2 (White)
+            const Stone &s = room->stones[i];
+            b->play(s.r * BOARD_SIZE + s.c, (s.color == 1) ? 1 : -1);
+        }
+        room->ai.store(b, std::memory_order_release);
+    }
+    return b;
+}
+
+void AI_Board::from_room(GameRoom *room)
+{
+    // Called between begin_search and end_search, so the slot is not
+    // reused meanwhile; a destroyed room leaves an empty board.
+    const AI_Board *src = room_position(room);
+    if (!read_room(room, room->id, [&]() { copy_position(*src); }))
+        clear();
+    memset(killers, -1, sizeof(killers));
+    memset(history, 0, sizeof(history));
+}
+
+// Empties the board. Caller holds a RoomWrite.
+void clear_board(GameRoom *room)
+{
+    room->stone_count = 0;
+    room->can_place_color = 1;
+    memset(room->grid, 0, sizeof(room->grid));
+    if (AI_Board *b = room->ai.load(std::memory_order_relaxed))
+        b->clear();
+}
+
+// --- Lazy SMP ------------------------------------------------------------
+// Helper threads run their own iterative deepening on a copy of the board
+// and share work only through the room's lock-free transposition table.
+// Odd helpers start one ply deeper and every helper visits the root moves
+// from a different offset, so they fill the table ahead of the main thread.
+// Helpers are parked between searches rather than started for each one.
+int ai_threads = 1;
+
+struct SmpHelper
+{
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool busy = false; // a search is running on it; guarded by mutex
+    AI_Board board;
+    int index = 0;
+    int first_depth = 0;
+    int max_depth = 0;
+    uint64_t nodes = 0;
+    int depth = 0;
+    int move = -1;
+    AI_STAT(AiStats stat;)
+
+    void run()
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return busy; });
+            }
+            for (int d = first_depth + ((index + 1) & 1); d <= max_depth; d++)
+            {
+                int best_val;
+                int m = board.search_root(d, move, best_val, 3 * (index + 1));
+                if (m == -1)
+                    break;
+                move = m;
+                depth = d;
+            }
+            nodes = board.nodes;
+            AI_STAT(stat = board.stat;)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busy = false;
+            }
+            wake.notify_all();
+        }
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !busy; });
+    }
+};
+
+// Idle helpers, grown to the most that concurrent searches have needed at
+// once. Helper threads are detached and live as long as the process.
+struct SmpHelperPool
+{
+    std::mutex mutex;
+    std::vector<SmpHelper *> idle;
+
+    SmpHelper *take()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty())
+            {
+                SmpHelper *h = idle.back();
+                idle.pop_back();
+                return h;
+            }
+        }
+        SmpHelper *h = new SmpHelper();
+        std::thread([h]() { h->run(); }).detach();
+        return h;
+    }
+
+    void give_back(SmpHelper *h)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(h);
+    }
+};
+
+// Never destroyed: parked helpers outlive static teardown.
+SmpHelperPool &smp_pool = *new SmpHelperPool();
+
+struct SmpGroup
+{
+    std::atomic<bool> stop{false};
+    SmpHelper *helpers[63];
+    int n = 0;
+
+    void start(const AI_Board &root, int first_depth, int max_depth, int first_move)
+    {
+        n = std::min(root.threads ? root.threads : ai_threads, 64) - 1;
+        for (int i = 0; i < n; i++)
+        {
+            SmpHelper *h = helpers[i] = smp_pool.take();
+            h->board = root;
+            h->board.abort = &stop;
+            h->board.progress = nullptr;
+            h->board.nodes = 0;
+            AI_STAT(h->board.stat_begin();)
+            h->index = i;
+            h->first_depth = first_depth;
+            h->max_depth = max_depth;
+            h->nodes = 0;
+            h->depth = 0;
+            h->move = first_move;
+            {
+                std::lock_guard<std::mutex> lock(h->mutex);
+                h->busy = true;
+            }
+            h->wake.notify_all();
+        }
+    }
+
+    // Stops the helpers, waits for them and parks them again; adopts a
+    // helper's move if it finished a deeper iteration than the main thread.
+    void finish(AI_Board &main, int &best_move, int &depth_reached)
+    {
+        stop.store(true, std::memory_order_relaxed);
+        for (int i = 0; i < n; i++)
+        {
+            SmpHelper &h = *helpers[i];
+            h.wait();
+            main.nodes += h.nodes;
+            AI_STAT(main.stat.tt_probes += h.stat.tt_probes; main.stat.tt_hits += h.stat.tt_hits;
+                    main.stat.cutoffs += h.stat.cutoffs;)
+            if (h.depth > depth_reached && h.move != -1)
+            {
+                depth_reached = h.depth;
+                best_move = h.move;
+            }
+            smp_pool.give_back(&h);
+        }
+        n = 0;
+    }
+};
+
+// --- Threat-space solver --------------------------------------------------
+// Looks for a forced win built only from fours (VCF) or from fours and open
+// threes (VCT). The defender only gets the cells that actually answer the
+// threat, plus counter-fours against a three, which keeps the tree narrow
+// enough to read well past ten attacking moves. Attacker-to-move results go
+// to the room's transposition table as proofs (valid at any greater depth)
+// and refutations (valid at any smaller depth).
+#define VCF_DEPTH 16
+#define VCT_DEPTH 8
+
+uint64_t threat_node_limit = 20000;
+
+struct ThreatSolver
+{
+    AI_Board &b;
+    int att; // attacker colour index
+    bool vct;
+    uint64_t nodes = 0;
+    bool aborted = false;
+
+    ThreatSolver(AI_Board &board, int p, bool vct_mode) : b(board), att(AI_Board::side(p)), vct(vct_mode) {}
+
+    static int colour(int c) { return c == 0 ? 1 : -1; }
+
+    // First move of a win within `depth` attacking moves, or -1 (also when
+    // the node limit or the board's deadline cut the search short).
+    int solve(int depth)
+    {
+        int first = -1;
+        return attack(depth, &first) && !aborted ? first : -1;
+    }
+
+    uint64_t cache_key() const
+    {
+        return b.hash ^ (vct ? ZK.vct : ZK.vcf) ^ (att ? ZK.side : 0);
+    }
+
+    bool over_budget()
+    {
+        AI_STAT(b.stat.threat_nodes++;)
+        if (++nodes > threat_node_limit || b.tick())
+            aborted = true;
+        return aborted;
+    }
+
+    bool attack(int depth, int *first = nullptr)
+    {
+        int f[CELLS];
+        if (over_budget())
+            return false;
+        if (b.five_cells(att, f))
+        {
+            if (first)
+                *first = f[0];
+            return true;
+        }
+        if (depth == 0)
+            return false;
+        const uint64_t k = cache_key();
+        TTHit hit;
+        AI_STAT(b.stat.tt_probes += b.tt != nullptr;)
+        if (b.tt && b.tt->probe(k, hit))
+        {
+            AI_STAT(b.stat.tt_hits++;)
+            bool usable = hit.move >= 0 && b.at(hit.move) == 0;
+            if (hit.bound == TT_LOWER && hit.depth <= depth && (usable || !first))
+            {
+                if (first)
+                    *first = hit.move;
+                return true;
+            }
+            if (hit.bound == TT_UPPER && hit.depth >= depth)
+                return false;
+        }
+        MoveList ml;
+        int nf = b.five_cells(att ^ 1, f);
+        if (nf >= 2)
+            return false;
+        if (nf == 1)
+            ml.push(f[0]); // must block the defender's four first
+        else
+            attacks(ml);
+        int proof = -1;
+        for (int m : ml)
+        {
+            b.play(m, colour(att));
+            bool won = defend(depth - 1);
+            b.undo(m, colour(att));
+            if (aborted)
+                return false;
+            if (won)
+            {
+                proof = m;
+                break;
+            }
+        }
+        if (b.tt)
+            b.tt->store(k, depth, proof != -1 ? TT_LOWER : TT_UPPER, proof != -1, proof);
+        if (first)
+            *first = proof;
+        return proof != -1;
+    }
+
+    // Defender to move: true if every answer still loses.
+    bool defend(int depth)
+    {
+        const int def = att ^ 1;
+        int f[CELLS];
+        if (b.five_cells(def, f))
+            return false;
+        int nf = b.five_cells(att, f);
+        if (nf >= 2)
+            return true;
+        if (nf == 1)
+        {
+            b.play(f[0], colour(def));
+            bool won = attack(depth);
+            b.undo(f[0], colour(def));
+            return won;
+        }
+        if (!vct)
+            return false;
+        MoveList ml;
+        if (!three_defences(ml))
+            return false;
+        for (int m : ml)
+        {
+            b.play(m, colour(def));
+            bool won = attack(depth);
+            b.undo(m, colour(def));
+            if (!won || aborted)
+                return false;
+        }
+        return true;
+    }
+
+    static void push_line(MoveList &ml, LineBits seen[BOARD_SIZE], int line, LineBits cells)
+    {
+        for (; cells; cells &= cells - 1)
+        {
+            int m = LT.cell_at[line][__builtin_ctz(cells)];
+            LineBits bit = 1u << (m % BOARD_SIZE);
+            if (!(seen[m / BOARD_SIZE] & bit))
+            {
+                seen[m / BOARD_SIZE] |= bit;
+                ml.push(m);
+            }
+        }
+    }
+
+    // Cells giving colour c a four, i.e. a five threat.
+    void four_moves(int c, MoveList &ml, LineBits seen[BOARD_SIZE])
+    {
+        for (int l = 0; l < NUM_LINES; l++)
+            if (b.pat[c][l] >= P_THREE && b.pat[c][l] <= P_OPEN_THREE)
+                push_line(ml, seen, l, four_cells(b.bits[c][l], b.bits[c ^ 1][l], LT.len[l]));
+    }
+
+    // Fours first; in VCT mode then every cell that makes an open three.
+    void attacks(MoveList &ml)
+    {
+        LineBits seen[BOARD_SIZE] = {};
+        four_moves(att, ml, seen);
+        if (!vct)
+            return;
+        for (int l = 0; l < NUM_LINES; l++)
+        {
+            if (b.pat[att][l] < P_TWO || b.pat[att][l] > P_THREE)
+                continue;
+            LineBits own = b.bits[att][l], opp = b.bits[att ^ 1][l];
+            LineBits reach = own << 1 | own << 2 | own << 3 | own >> 1 | own >> 2 | own >> 3;
+            LineBits threes = 0;
+            for (LineBits e = reach & LT.full[l] & ~(own | opp); e; e &= e - 1)
+                if (straight_four_cells(own | (e & -e), opp, LT.len[l]))
+                    threes |= e & -e;
+            push_line(ml, seen, l, threes);
+        }
+    }
+
+    // Answers to the attacker's open three(s): cells that leave no straight
+    // four on any threatened line, then the defender's counter-fours. False
+    // if the attacker has no open three standing.
+    bool three_defences(MoveList &ml)
+    {
+        int lines[NUM_LINES], n = 0;
+        for (int l = 0; l < NUM_LINES; l++)
+            if (b.pat[att][l] == P_OPEN_THREE || b.pat[att][l] == P_SPLIT_THREE)
+                lines[n++] = l;
+        if (n == 0)
+            return false;
+        LineBits seen[BOARD_SIZE] = {};
+        int l0 = lines[0];
+        LineBits span = 0;
+        straight_four_cells(b.bits[att][l0], b.bits[att ^ 1][l0], LT.len[l0], &span);
+        for (; span; span &= span - 1)
+        {
+            int m = LT.cell_at[l0][__builtin_ctz(span)];
+            bool kills = true;
+            for (int i = 0; i < n && kills; i++)
+            {
+                int l = lines[i], d = 0;
+                while (d < 4 && LT.slot[m][d].line != l)
+                    d++;
+                kills = d < 4 && !straight_four_cells(b.bits[att][l], b.bits[att ^ 1][l] | 1u << LT.slot[m][d].pos, LT.len[l]);
+            }
+            if (kills)
+                push_line(ml, seen, LT.slot[m][1].line, 1u << LT.slot[m][1].pos);
+        }
+        four_moves(att ^ 1, ml, seen);
+        return true;
+    }
+};
+
+// --- Opening book --------------------------------------------------------
+// Moves for early positions, read from a file of BookEntry sorted by key
+// (load_opening_book) and mapped read-only, so every process serving the
+// same file shares one copy. Keys are symmetry-normalised: the smallest
+// Zobrist key over the 8 rotations and reflections of the board, with the
+// move stored in that orientation. tools/book_gen.cpp writes the file.
+#define BOOK_MAX_STONES 12
+#define BOOK_MAGIC "DBBOOK1"
+
+struct BookHeader
+{
+    char magic[8];
+    uint64_t count;
+};
+
+struct BookEntry
+{
+    uint64_t key;
+    uint16_t move; // r * BOARD_SIZE + c in the normalised orientation
+    uint16_t pad;
+    uint32_t weight; // preferred when a position has several moves
+};
+
+struct OpeningBook
+{
+    const BookEntry *entries;
+    size_t count;
+};
+
+// Replaced books stay mapped: a search may still be reading one.
+std::atomic<const OpeningBook *> opening_book{nullptr};
+
+// Symmetry k (0..7) of cell m: flip rows if k & 1, flip columns if k & 2,
+// then transpose if k & 4. book_unsym undoes it.
+inline int book_sym(int k, int m)
+{
+    int r = m / BOARD_SIZE, c = m % BOARD_SIZE;
+    if (k & 1)
+        r = BOARD_SIZE - 1 - r;
+    if (k & 2)
+        c = BOARD_SIZE - 1 - c;
+    return k & 4 ? c * BOARD_SIZE + r : r * BOARD_SIZE + c;
+}
+
+inline int book_unsym(int k, int m)
+{
+    int r = m / BOARD_SIZE, c = m % BOARD_SIZE;
+    if (k & 4)
+        std::swap(r, c);
+    if (k & 1)
+        r = BOARD_SIZE - 1 - r;
+    if (k & 2)
+        c = BOARD_SIZE - 1 - c;
+    return r * BOARD_SIZE + c;
+}
+
+// Book key of b's stones with p to move; *sym gets the symmetry it was
+// taken in (the lowest one on ties, so lookups agree with the generator).
+uint64_t book_key(const AI_Board &b, int p, int *sym)
+{
+    uint64_t h[8] = {};
+    for (int m = 0; m < CELLS; m++)
+        if (int s = b.at(m))
+            for (int k = 0; k < 8; k++)
+                h[k] ^= ZK.stone[AI_Board::side(s)][book_sym(k, m)];
+    int best = 0;
+    for (int k = 1; k < 8; k++)
+        if (h[k] < h[best])
+            best = k;
+    *sym = best;
+    return p == 1 ? h[best] : h[best] ^ ZK.side;
+}
+
+// The book's heaviest legal move for p in b, or -1.
+int book_probe(const AI_Board &b, int p)
+{
+    const OpeningBook *book = opening_book.load(std::memory_order_acquire);
+    if (!book || b.stones > BOOK_MAX_STONES)
+        return -1;
+    int sym;
+    uint64_t key = book_key(b, p, &sym);
+    const BookEntry *end = book->entries + book->count;
+    const BookEntry *e = std::lower_bound(book->entries, end, key,
+                                          [](const BookEntry &x, uint64_t k) { return x.key < k; });
+    int best = -1;
+    uint32_t best_weight = 0;
+    for (; e != end && e->key == key; e++)
+    {
+        if (e->move >= CELLS)
+            continue;
+        int m = book_unsym(sym, e->move);
+        if (e->weight > best_weight && b.at(m) == 0)
+        {
+            best = m;
+            best_weight = e->weight;
+        }
+    }
+    return best;
+}
+
+// Immediate win, block, opening book, threat-space search, then negamax deepened from
+// min_depth to max_depth plies while the deadline allows. Under a deadline
+// the first iteration runs before the threat search and always completes,
+// so there is a move to fall back to.
+int AI_Board::choose_move(int min_depth, int max_depth, int &depth_reached)
+{
+    depth_reached = 0;
+    AI_STAT(stat_begin();)
+    // 1. Immediate win
+    int m = find_five(turn);
+    AI_STAT(stat_lap(AI_PHASE_WIN, m);)
+    // 2. Block immediate opponent win
+    if (m == -1)
+        m = find_five(-turn);
+    AI_STAT(stat_lap(AI_PHASE_BLOCK, m);)
+    if (m == -1)
+        m = book_probe(*this, turn);
+    AI_STAT(stat_lap(AI_PHASE_BOOK, m);)
+    if (m == -1)
+    {
+        MoveList root;
+        candidates(root);
+        if (root.n == 1)
+            m = root.m[0];
+    }
+    AI_STAT(stat_lap(AI_PHASE_ONLY, m);)
+    if (m != -1)
+    {
+        depth_reached = 1;
+        return m;
+    }
+
+    int best_move = -1, best_val, depth = min_depth;
+    if (deadline_us)
+    {
+        int64_t deadline = deadline_us;
+        deadline_us = 0;
+        best_move = search_root(depth, -1, best_val);
+        deadline_us = deadline;
+        depth_reached = depth++;
+        AI_STAT(stat_lap(AI_PHASE_NEGAMAX, -1);)
+    }
+
+    // 3. Threat-space search: continuous fours, then fours and threes
+    m = ThreatSolver(*this, turn, false).solve(VCF_DEPTH);
+    if (m == -1 && !stopped)
+        m = ThreatSolver(*this, turn, true).solve(VCT_DEPTH);
+    AI_STAT(stat_lap(AI_PHASE_THREAT, m);)
+    if (m != -1)
+        return m;
+    AI_STAT(stat.phase = AI_PHASE_NEGAMAX;)
+    if (stopped)
+        return best_move;
+
+    // 4. Negamax, with Lazy SMP helpers when ai_threads > 1
+    SmpGroup smp;
+    smp.start(*this, depth, max_depth, best_move);
+    for (; depth <= max_depth; depth++)
+    {
+        int move = search_root(depth, best_move, best_val);
+        if (move == -1)
+            break;
+        best_move = move;
+        depth_reached = depth;
+        if (progress)
+        {
+            progress->depth.store(depth, std::memory_order_relaxed);
+            progress->nodes.store((long long)nodes, std::memory_order_relaxed);
+        }
+    }
+    smp.finish(*this, best_move, depth_reached);
+    AI_STAT(stat_lap(AI_PHASE_NEGAMAX, best_move);)
+    return best_move;
+}
+
+// Serialises table (re)allocation against searches that are using it.
+std::mutex ai_mutex;
+
+// Points the board at the room's table, (re)allocating it to the current
+// budget unless another search holds it. Pair with end_search; false (and
+// nothing to end) if room `id` has been destroyed meanwhile, its slot
+// perhaps reused. Until end_search the slot stays with this room.
+bool begin_search(AI_Board &b, GameRoom *room, long long id)
+{
+    std::lock_guard<std::mutex> lock(ai_mutex);
+    if (!room->live || room->id != id)
+        return false;
+    room->searches++;
+    b.tt = nullptr;
+    if (tt_budget_bytes == 0)
+        return true;
+    if (!room->tt)
+        room->tt = new TransTable();
+    if (room->tt->bytes != tt_budget_bytes && room->searches == 1)
+        room->tt->resize(tt_budget_bytes);
+    room->tt->new_search();
+    b.tt = room->tt;
+    return true;
+}
+
+// Frees a destroyed room's table and slot once no search holds them.
+// Caller holds ai_mutex.
+void retire_room(GameRoom *room)
+{
+    if (room->live || room->searches > 0)
+        return;
+    delete room->tt;
+    room->tt = nullptr;
+    room_registry.release(room->slot);
+}
+
+void end_search(GameRoom *room)
+{
+    std::lock_guard<std::mutex> lock(ai_mutex);
+    room->searches--;
+    retire_room(room);
+}
+
+#ifdef AI_STATS
+// Principal variation after a negamax decision: the chosen move, then the
+// table's move for each following position while it is legal and the line
+// is not already won. b is left as it was.
+int search_pv(AI_Board &b, int move, int *pv)
+{
+    int n = 0;
+    for (int m = move; m >= 0 && m < CELLS && n < AI_PV_MAX && b.at(m) == 0;)
+    {
+        pv[n++] = m;
+        b.play(m, b.turn);
+        b.turn = -b.turn;
+        TTHit hit;
+        if (b.win_at(m) || !b.tt || !b.tt->probe(b.key(), hit))
+            break;
+        m = hit.move;
+    }
+    for (int i = n - 1; i >= 0; i--)
+    {
+        b.turn = -b.turn;
+        b.undo(pv[i], b.turn);
+    }
+    return n;
+}
+
+// Files a finished search under its room and in the latency histogram.
+// Call between choose_move and end_search.
+void record_search(GameRoom *room, AI_Board &b, int move, int depth)
+{
+    AiStats &s = b.stat;
+    s.nodes = (long long)b.nodes;
+    s.total_us = now_us() - b.stat_start_us;
+    s.depth = depth;
+    s.threads = b.threads ? b.threads : ai_threads;
+    if (s.phase == AI_PHASE_NEGAMAX)
+        s.pv_len = search_pv(b, move, s.pv);
+    else if (move != -1)
+    {
+        s.pv[0] = move;
+        s.pv_len = 1;
+    }
+    int bucket = s.total_us > 0 ? 63 - __builtin_clzll((unsigned long long)s.total_us) : 0;
+    ai_latency_hist[std::min(bucket, AI_HIST_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(room->lock);
+    room->ai_stats = s;
+}
+#endif
+
+// --- Asynchronous AI jobs -------------------------------------------------
+// ai_begin snapshots the room and queues a timed search on a worker pool the
+// library owns; callers poll for progress and the result instead of holding
+// a thread for the whole search. A ticket encodes its slot, so lookups are
+// O(1) and a reused slot never answers for an old ticket.
+#define MAX_AI_JOBS 256
+
+enum AiJobState
+{
+    AI_JOB_FREE,
+    AI_JOB_QUEUED,
+    AI_JOB_RUNNING,
+    AI_JOB_DONE,
+    AI_JOB_CANCELLED
+};
+
+enum AiPollStatus
+{
+    AI_POLL_UNKNOWN = -1,
+    AI_POLL_PENDING = 0,
+    AI_POLL_DONE = 1,
+    AI_POLL_CANCELLED = 2
+};
+
+struct AiJob
+{
+    long long ticket = 0;
+    int state = AI_JOB_FREE;
+    bool detached = false; // owner gave up on it; freed as soon as it stops
+    bool ponder = false;   // speculative; yields its worker to real searches
+    GameRoom *room = nullptr;
+    int64_t deadline_us = 0;
+    int move = -1;
+    std::atomic<bool> cancel{false};
+    SearchProgress progress;
+    AI_Board board;
+};
+
+struct AiJobPool
+{
+    std::mutex mutex; // guards job states, the queue and the worker list
+    std::condition_variable wake;
+    AiJob jobs[MAX_AI_JOBS];
+    int queue[MAX_AI_JOBS];
+    int head = 0, count = 0;
+    long long next_seq = 1;
+    int workers = 0; // detached; they live as long as the process
+    int idle = 0;    // workers waiting for a job
+    int target_workers = 2;
+
+    AiJob *find(long long ticket)
+    {
+        if (ticket <= 0)
+            return nullptr;
+        AiJob *job = &jobs[ticket % MAX_AI_JOBS];
+        return job->ticket == ticket ? job : nullptr;
+    }
+
+    void release(AiJob *job)
+    {
+        job->state = AI_JOB_FREE;
+        job->ticket = 0;
+    }
+
+    // Caller holds mutex.
+    void ensure_workers()
+    {
+        for (; workers < target_workers; workers++)
+            std::thread([this]() { work(); }).detach();
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            AiJob *job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                idle++;
+                wake.wait(lock, [this]() { return count > 0; });
+                idle--;
+                job = &jobs[queue[head]];
+                head = (head + 1) % MAX_AI_JOBS;
+                count--;
+                if (job->cancel.load(std::memory_order_relaxed))
+                {
+                    if (job->ponder)
+                        clear_ponder(job->room, job->ticket);
+                    end_search(job->room);
+                    finish(job, AI_JOB_CANCELLED);
+                    continue;
+                }
+                job->state = AI_JOB_RUNNING;
+            }
+            GameRoom *room = job->room;
+            AI_Board &b = job->board;
+            b.abort = &job->cancel;
+            b.progress = &job->progress;
+            b.deadline_us = job->deadline_us;
+            int depth;
+            job->move = b.choose_move(1, AI_MAX_DEPTH, depth);
+            AI_STAT(if (!job->ponder) record_search(room, b, job->move, depth);)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (job->ponder)
+                    clear_ponder(room, job->ticket);
+                finish(job, job->cancel.load(std::memory_order_relaxed) ? AI_JOB_CANCELLED : AI_JOB_DONE);
+            }
+            end_search(room);
+        }
+    }
+
+    // Caller holds mutex.
+    void finish(AiJob *job, int state)
+    {
+        if (job->detached)
+            release(job);
+        else
+            job->state = state;
+    }
+
+    // Caller holds mutex. Queues a job for the room's current position and
+    // returns its ticket, or -1 if every slot is taken.
+    long long submit(GameRoom *room, long long room_id, int color, int budget_us, bool speculative)
+    {
+        if (count == MAX_AI_JOBS)
+            return -1;
+        int slot = -1;
+        for (int i = 0; i < MAX_AI_JOBS && slot == -1; i++)
+        {
+            int s = (int)((next_seq + i) % MAX_AI_JOBS);
+            if (jobs[s].state == AI_JOB_FREE)
+                slot = s;
+        }
+        if (slot == -1)
+            return -1;
+        long long ticket = next_seq + ((slot - next_seq) % MAX_AI_JOBS + MAX_AI_JOBS) % MAX_AI_JOBS;
+        next_seq = ticket + 1;
+
+        AiJob *job = &jobs[slot];
+        job->ticket = ticket;
+        job->state = AI_JOB_QUEUED;
+        job->detached = speculative; // nobody polls a ponder job
+        job->ponder = speculative;
+        job->room = room;
+        job->deadline_us = speculative ? 0 : now_us() + std::max(budget_us, 1);
+        job->move = -1;
+        job->cancel.store(false, std::memory_order_relaxed);
+        job->progress.depth.store(0, std::memory_order_relaxed);
+        job->progress.nodes.store(0, std::memory_order_relaxed);
+        if (!begin_search(job->board, room, room_id))
+        {
+            release(job);
+            return -1;
+        }
+        job->board.from_room(room);
+        job->board.turn = (color == 1) ? 1 : -1;
+        job->board.threads = speculative ? 1 : 0;
+        job->board.nodes = 0;
+        job->board.stopped = false;
+
+        queue[(head + count) % MAX_AI_JOBS] = slot;
+        count++;
+        ensure_workers();
+        wake.notify_one();
+        return ticket;
+    }
+
+    // Caller holds mutex. Forgets a finished ponder job unless the room has
+    // moved on to a newer one.
+    void clear_ponder(GameRoom *room, long long ticket)
+    {
+        if (room->ponder_ticket.load(std::memory_order_relaxed) == ticket)
+            room->ponder_ticket.store(0, std::memory_order_relaxed);
+    }
+
+    // Caller holds mutex. Stops the room's ponder job, if any.
+    void stop_ponder(GameRoom *room)
+    {
+        if (AiJob *job = find(room->ponder_ticket.load(std::memory_order_relaxed)))
+            cancel(job);
+        room->ponder_ticket.store(0, std::memory_order_relaxed);
+    }
+
+    // Caller holds mutex. Cancels a job; its slot is freed once it stops.
+    void cancel(AiJob *job)
+    {
+        job->cancel.store(true, std::memory_order_relaxed);
+        if (job->state == AI_JOB_DONE || job->state == AI_JOB_CANCELLED)
+            release(job);
+        else
+            job->detached = true;
+    }
+};
+
+// Never destroyed: workers may still be waiting on it during static teardown.
+AiJobPool &ai_pool = *new AiJobPool();
+
+bool ai_pondering = true;
+
+// Copies a room's full state in get_state's layout; run it under read_room.
+// Returns false, copying nothing, if the room has more than max_players.
+bool copy_state(const GameRoom *room, int *players_buffer, int max_players, int *out_p_count, int *stones_buffer,
+                int *out_s_count)
+{
+    const PlayerTable &pt = *room->players;
+    int p_idx = 0;
+    int active_count = std::min(std::max(pt.count, 0), pt.capacity);
+    if (active_count > max_players)
+        return false;
+    for (int i = 0; i < active_count; ++i)
+    {
+        const Player &p = pt.slots[std::min(std::max(pt.active[i], 0), pt.capacity - 1)];
+        players_buffer[p_idx++] = p.id;
+        players_buffer[p_idx++] = p.r;
+        players_buffer[p_idx++] = p.c;
+    }
+    *out_p_count = active_count;
+    int stone_count = std::min(std::max(room->stone_count, 0), MAX_STONES);
+    int s_idx = 0;
+    for (int i = 0; i < stone_count; ++i)
+    {
+        stones_buffer[s_idx++] = room->stones[i].r;
+        stones_buffer[s_idx++] = room->stones[i].c;
+        stones_buffer[s_idx++] = room->stones[i].color;
+    }
+    // Append the currently allowed color to place (1=Black, 2=White)
+    stones_buffer[s_idx++] = room->can_place_color;
+    *out_s_count = stone_count;
+    return true;
+}
+
+// get_state_since into a players_buffer of max_players entries (-1: the
+// room's capacity). Returns -1, with nothing usable in the buffers, if the
+// room's players do not fit.
+int state_since(long long room_id, long long since, int *players_buffer, int max_players, int *out_p_count,
+                int *stones_buffer, int *out_s_count, long long *out_version)
+{
+    GameRoom *room = room_registry.find(room_id);
+    int full = 0;
+    bool found = room && read_room(room, room_id, [&]() {
+        const PlayerTable &pt = *room->players;
+        int limit = max_players < 0 ? pt.capacity : std::min(max_players, pt.capacity);
+        long long v = room->version;
+        *out_version = v;
+        full = since < 0 || since > v || v - since > ROOM_LOG_SIZE;
+        for (long long k = since + 1; !full && k <= v; k++)
+            full = room->log[k % ROOM_LOG_SIZE].kind == CHANGE_RESET;
+        if (full)
+        {
+            if (!copy_state(room, players_buffer, limit, out_p_count, stones_buffer, out_s_count))
+                full = -1;
+            return;
+        }
+        int p_count = 0;
+        for (long long k = since + 1; k <= v; k++)
+        {
+            const RoomChange &e = room->log[k % ROOM_LOG_SIZE];
+            if (e.kind != CHANGE_PLAYER)
+                continue;
+            bool seen = false;
+            for (int i = 0; i < p_count && !seen; i++)
+                seen = players_buffer[i * 3] == e.player_id;
+            if (seen)
+                continue;
+            if (p_count == limit)
+            {
+                // More ids churned than the buffer holds players.
+                full = copy_state(room, players_buffer, limit, out_p_count, stones_buffer, out_s_count) ? 1 : -1;
+                return;
+            }
+            const Player *p = pt.find(e.player_id);
+            players_buffer[p_count * 3] = e.player_id;
+            players_buffer[p_count * 3 + 1] = p ? p->r : -1;
+            players_buffer[p_count * 3 + 2] = p ? p->c : -1;
+            p_count++;
+        }
+        *out_p_count = p_count;
+        int stone_count = std::min(std::max(room->stone_count, 0), MAX_STONES);
+        int first = v > since ? room->log[(since + 1) % ROOM_LOG_SIZE].stones_before : stone_count;
+        first = std::min(std::max(first, 0), stone_count);
+        int s_idx = 0;
+        for (int i = first; i < stone_count; ++i)
+        {
+            stones_buffer[s_idx++] = room->stones[i].r;
+            stones_buffer[s_idx++] = room->stones[i].c;
+            stones_buffer[s_idx++] = room->stones[i].color;
+        }
+        stones_buffer[s_idx++] = room->can_place_color;
+        *out_s_count = stone_count - first;
+    });
+    if (!found)
+    {
+        *out_p_count = 0;
+        *out_s_count = 0;
+        stones_buffer[0] = 1;
+        *out_version = 0;
+        return 1;
+    }
+    return full;
+}
+
+// --- Room shards ---------------------------------------------------------
+// Optional single-writer execution: each room belongs to one shard (by the
+// hash of its id), and each shard is a worker thread that applies the
+// commands submitted for its rooms in submission order. Submitters never
+// lock or wait; they push onto the shard's bounded lock-free queue. Since
+// only the owning worker writes a room, its RoomWrite lock is never
+// contended. Readers keep using the seqlock.
+#define MAX_SHARDS 64
+#define SHARD_QUEUE 4096 // commands per shard; a power of two
+
+// Command kinds are RoomCommandKind, in game_logic.h.
+
+struct RoomCommand
+{
+    long long room_id;
+    int kind;
+    int player_id;
+    int a, b;
+    int color;
+    long long epoch; // the room's when queued; -1 if it did not exist
+};
+
+struct ShardCell
+{
+    std::atomic<size_t> seq;
+    RoomCommand cmd;
+};
+
+// Bounded multi-producer queue with one consumer. A cell's seq tells whose
+// turn it is: pos for the producer that claims position pos, pos + 1 once
+// the command is in, pos + SHARD_QUEUE once the consumer is done with it.
+struct ShardQueue
+{
+    ShardCell cells[SHARD_QUEUE];
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0; // consumer only
+
+    ShardQueue()
+    {
+        for (size_t i = 0; i < SHARD_QUEUE; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    bool push(const RoomCommand &cmd)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            ShardCell &cell = cells[pos & (SHARD_QUEUE - 1)];
+            intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.cmd = cmd;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // full
+            else
+                pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool pop(RoomCommand *out)
+    {
+        ShardCell &cell = cells[head & (SHARD_QUEUE - 1)];
+        if (cell.seq.load(std::memory_order_acquire) != head + 1)
+            return false;
+        *out = cell.cmd;
+        cell.seq.store(head + SHARD_QUEUE, std::memory_order_release);
+        head++;
+        return true;
+    }
+};
+
+struct Shard
+{
+    ShardQueue queue;
+    std::mutex mutex; // only for sleeping and waking the worker
+    std::condition_variable wake;
+    std::atomic<bool> sleeping{false};
+    std::atomic<size_t> applied{0}; // commands run so far (wait_room_commands)
+};
+
+// Never destroyed, like ai_pool: the workers are detached.
+Shard *shards[MAX_SHARDS];
+std::atomic<int> shard_count{0};
+std::mutex shard_start_mutex;
+
+extern "C"
+{
+    int remove_player(long long room_id, int player_id);
+    bool place_stone(long long room_id, int r, int c, int color);
+    void reset_game(long long room_id);
+}
+
+void apply_command(const RoomCommand &cmd)
+{
+    int r, c;
+    command_epoch = cmd.epoch;
+    switch (cmd.kind)
+    {
+    case ROOM_CMD_MOVE:
+        move_player(cmd.room_id, cmd.player_id, cmd.a, cmd.b, &r, &c);
+        break;
+    case ROOM_CMD_PLACE:
+        r = cmd.a;
+        c = cmd.b;
+        if (r < 0)
+            move_player(cmd.room_id, cmd.player_id, 0, 0, &r, &c);
+        if (place_stone(cmd.room_id, r, c, cmd.color))
+            if (GameRoom *room = room_registry.find(cmd.room_id))
+                mark_urgent(room);
+        break;
+    case ROOM_CMD_RESET:
+        reset_game(cmd.room_id);
+        if (GameRoom *room = room_registry.find(cmd.room_id))
+            mark_urgent(room);
+        break;
+    case ROOM_CMD_REMOVE:
+        remove_player(cmd.room_id, cmd.player_id);
+        break;
+    }
+    command_epoch = 0;
+}
+
+void run_shard(Shard *shard)
+{
+    RoomCommand cmd;
+    for (;;)
+    {
+        while (shard->queue.pop(&cmd))
+        {
+            apply_command(cmd);
+            shard->applied.store(shard->queue.head, std::memory_order_release);
+        }
+        std::unique_lock<std::mutex> lock(shard->mutex);
+        shard->sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        shard->wake.wait(lock, [shard] {
+            ShardCell &cell = shard->queue.cells[shard->queue.head & (SHARD_QUEUE - 1)];
+            return cell.seq.load(std::memory_order_acquire) == shard->queue.head + 1;
+        });
+        shard->sleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+// Waits until the room's shard has run every command queued before the
+// call, so that what follows sees their effect.
+void wait_room_commands(long long room_id)
+{
+    int n = shard_count.load(std::memory_order_acquire);
+    if (n == 0)
+        return;
+    Shard *shard = shards[RoomRegistry::hash(room_id) % n];
+    size_t queued = shard->queue.tail.load(std::memory_order_acquire);
+    while (shard->applied.load(std::memory_order_acquire) < queued)
+        std::this_thread::yield();
+}
+
+// --- Journal files -------------------------------------------------------
+// <dir>/journal.<segment> holds JournalRecords back to back. <dir>/snapshot
+// is written through a shared mapping, then renamed into place:
+//   SnapshotHeader, then per room a SnapshotRoom followed by its stones
+//   (u8 r, u8 c; colours alternate from black) and players (SnapshotPlayer).
+// Recovery restores the snapshot through the exports, then replays the
+// segments from its base on. A torn record ends its segment's replay.
+#ifdef HAVE_JOURNAL
+#define SNAPSHOT_MAGIC "DBSNAP1"
+
+struct SnapshotHeader
+{
+    char magic[8];
+    long long base_segment; // first segment not contained in the snapshot
+    long long rooms;
+    long long next_epoch;
+};
+
+struct SnapshotRoom
+{
+    long long id, epoch, version;
+    int32_t stones, players;
+};
+
+struct SnapshotPlayer
+{
+    int32_t id;
+    uint8_t r, c;
+    uint16_t pad;
+};
+
+extern "C"
+{
+    int create_room(long long room_id);
+    int destroy_room(long long room_id);
+}
+
+std::string journal_path(const char *name, long long segment = -1)
+{
+    char buf[32];
+    if (segment >= 0)
+        snprintf(buf, sizeof(buf), "/%s.%012lld", name, segment);
+    else
+        snprintf(buf, sizeof(buf), "/%s", name);
+    return journal.dir + buf;
+}
+
+bool write_all(int fd, const void *data, size_t n)
+{
+    const char *p = (const char *)data;
+    while (n > 0)
+    {
+        ssize_t w = write(fd, p, n);
+        if (w < 0)
+            return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+void sync_dir()
+{
+    int fd = open(journal.dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Segment numbers found in the journal directory, ascending.
+std::vector<long long> list_segments()
+{
+    std::vector<long long> out;
+    if (DIR *d = opendir(journal.dir.c_str()))
+    {
+        while (dirent *e = readdir(d))
+        {
+            long long n;
+            char tail;
+            if (sscanf(e->d_name, "journal.%lld%c", &n, &tail) == 1)
+                out.push_back(n);
+        }
+        closedir(d);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+// Writes every registered room to the snapshot file, marked as holding
+// everything journaled before segment base. Holds the registry's shared
+// lock, so rooms are neither created nor destroyed meanwhile; each room is
+// copied with read_room while its writers carry on.
+bool write_snapshot(long long base)
+{
+    std::shared_lock<std::shared_mutex> lock(room_registry.mutex);
+    size_t cap = sizeof(SnapshotHeader);
+    for (size_t i = 0; room_registry.index && i <= room_registry.mask; i++)
+        if (room_registry.index[i].slot != -1)
+            cap += sizeof(SnapshotRoom) + MAX_STONES * 2 +
+                   room_registry.at(room_registry.index[i].slot)->players->capacity * sizeof(SnapshotPlayer);
+
+    std::string tmp = journal_path("snapshot.tmp"), path = journal_path("snapshot");
+    int fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    void *map = ftruncate(fd, (off_t)cap) == 0 ? mmap(nullptr, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED)
+    {
+        close(fd);
+        unlink(tmp.c_str());
+        return false;
+    }
+
+    uint8_t *out = (uint8_t *)map + sizeof(SnapshotHeader);
+    SnapshotHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, SNAPSHOT_MAGIC, sizeof(head.magic));
+    head.base_segment = base;
+    head.next_epoch = next_room_epoch.load(std::memory_order_relaxed);
+    std::vector<int> p_buf;
+    int s_buf[MAX_STONES * 3 + 1];
+    for (size_t i = 0; room_registry.index && i <= room_registry.mask; i++)
+    {
+        if (room_registry.index[i].slot == -1)
+            continue;
+        GameRoom *room = room_registry.at(room_registry.index[i].slot);
+        p_buf.resize(room->players->capacity * 3);
+        SnapshotRoom sr;
+        int p_count, s_count;
+        // The shared registry lock keeps the room in its slot.
+        read_room(room, room->id, [&]() {
+            sr.version = room->version;
+            copy_state(room, p_buf.data(), room->players->capacity, &p_count, s_buf, &s_count);
+        });
+        sr.id = room->id;
+        sr.epoch = room->epoch;
+        sr.stones = s_count;
+        sr.players = p_count;
+        memcpy(out, &sr, sizeof(sr));
+        out += sizeof(sr);
+        for (int k = 0; k < s_count; k++)
+        {
+            *out++ = (uint8_t)s_buf[k * 3];
+            *out++ = (uint8_t)s_buf[k * 3 + 1];
+        }
+        for (int k = 0; k < p_count; k++)
+        {
+            SnapshotPlayer sp = {p_buf[k * 3], (uint8_t)p_buf[k * 3 + 1], (uint8_t)p_buf[k * 3 + 2], 0};
+            memcpy(out, &sp, sizeof(sp));
+            out += sizeof(sp);
+        }
+        head.rooms++;
+    }
+    lock.unlock();
+    memcpy(map, &head, sizeof(head));
+
+    size_t used = (size_t)(out - (uint8_t *)map);
+    bool ok = msync(map, used, MS_SYNC) == 0;
+    munmap(map, cap);
+    ok = ok && ftruncate(fd, (off_t)used) == 0 && fsync(fd) == 0;
+    close(fd);
+    ok = ok && rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok)
+        unlink(tmp.c_str());
+    sync_dir();
+    return ok;
+}
+
+// Recreates a snapshotted room by replaying its stones and players, then
+// puts back its version. The change log cannot be rebuilt, so it is filled
+// with resets: clients holding older versions get full states.
+void restore_room(const SnapshotRoom &sr, const uint8_t *stones, const uint8_t *players)
+{
+    create_room(sr.id);
+    GameRoom *room = room_registry.find(sr.id);
+    if (!room)
+        return;
+    room->epoch = sr.epoch;
+    for (int k = 0; k < sr.stones; k++)
+        place_stone(sr.id, stones[k * 2], stones[k * 2 + 1], k % 2 == 0 ? 1 : 2);
+    for (int k = 0; k < sr.players; k++)
+    {
+        SnapshotPlayer sp;
+        memcpy(&sp, players + k * sizeof(sp), sizeof(sp));
+        int r, c;
+        move_player(sr.id, sp.id, sp.c - BOARD_SIZE / 2, sp.r - BOARD_SIZE / 2, &r, &c);
+    }
+    RoomWrite w(room);
+    room->version = sr.version;
+    for (RoomChange &e : room->log)
+        e = RoomChange{CHANGE_RESET, 0, 0};
+}
+
+// Restores the snapshot, if there is a valid one; returns its base segment.
+long long load_snapshot()
+{
+    std::string path = journal_path("snapshot");
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    struct stat st;
+    void *map = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(SnapshotHeader)
+                    ? mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+    const uint8_t *p = (const uint8_t *)map, *end = p + st.st_size;
+    SnapshotHeader head;
+    memcpy(&head, p, sizeof(head));
+    p += sizeof(head);
+    long long base = 0;
+    if (memcmp(head.magic, SNAPSHOT_MAGIC, sizeof(head.magic)) == 0)
+    {
+        base = head.base_segment;
+        for (long long i = 0; i < head.rooms && end - p >= (ptrdiff_t)sizeof(SnapshotRoom); i++)
+        {
+            SnapshotRoom sr;
+            memcpy(&sr, p, sizeof(sr));
+            p += sizeof(sr);
+            size_t body = (size_t)sr.stones * 2 + (size_t)sr.players * sizeof(SnapshotPlayer);
+            if (sr.stones < 0 || sr.stones > MAX_STONES || sr.players < 0 || (size_t)(end - p) < body)
+                break;
+            restore_room(sr, p, p + sr.stones * 2);
+            p += body;
+        }
+        long long epoch = next_room_epoch.load(std::memory_order_relaxed);
+        next_room_epoch.store(std::max(epoch, head.next_epoch), std::memory_order_relaxed);
+    }
+    munmap(map, (size_t)st.st_size);
+    return base;
+}
+
+void replay_record(const JournalRecord &rec)
+{
+    GameRoom *room = room_registry.find(rec.room_id);
+    long long epoch = next_room_epoch.load(std::memory_order_relaxed);
+    next_room_epoch.store(std::max(epoch, rec.epoch + 1), std::memory_order_relaxed);
+    if (rec.kind == JR_CREATE)
+    {
+        if (room && room->epoch >= rec.epoch)
+            return;
+        if (room)
+            destroy_room(rec.room_id);
+        create_room(rec.room_id);
+        if ((room = room_registry.find(rec.room_id)))
+            room->epoch = rec.epoch;
+        return;
+    }
+    if (!room || room->epoch != rec.epoch)
+        return;
+    if (rec.kind == JR_DESTROY)
+    {
+        destroy_room(rec.room_id);
+        return;
+    }
+    if (rec.version <= room->version)
+        return;
+    int r, c;
+    switch (rec.kind)
+    {
+    case JR_MOVE:
+        move_player(rec.room_id, rec.player_id, rec.a, rec.b, &r, &c);
+        break;
+    case JR_REMOVE:
+        remove_player(rec.room_id, rec.player_id);
+        break;
+    case JR_PLACE:
+        place_stone(rec.room_id, rec.a, rec.b, rec.color);
+        break;
+    case JR_RESET:
+        reset_game(rec.room_id);
+        break;
+    }
+    RoomWrite w(room);
+    room->version = std::max(room->version, rec.version);
+}
+
+// Cursor moves are not journaled but do advance a room's version, so the
+// version recovered from the snapshot and journal can be behind what
+// clients were sent before the restart. Recovery moves every room this far
+// ahead, far more than the moves made between two snapshots, and fills its
+// change log with resets: every client's next frame is a full state.
+#define RECOVERY_VERSION_GAP (1LL << 32)
+
+void advance_recovered_versions()
+{
+    std::shared_lock<std::shared_mutex> lock(room_registry.mutex);
+    for (size_t i = 0; room_registry.index && i <= room_registry.mask; i++)
+    {
+        if (room_registry.index[i].slot == -1)
+            continue;
+        GameRoom *room = room_registry.at(room_registry.index[i].slot);
+        RoomWrite w(room);
+        room->version += RECOVERY_VERSION_GAP;
+        for (RoomChange &e : room->log)
+            e = RoomChange{CHANGE_RESET, 0, 0};
     }
-    return false;
 }
 
-bool makes_pattern(int g[BOARD_SIZE][BOARD_SIZE], int x, int y, int p, int target_len, bool open)
+void replay_segment(long long segment)
 {
-    bool res = false;
-    int original = g[x][y];
-    g[x][y] = p;
-    for (int d = 0; d < 4; d++)
+    std::string path = journal_path("journal", segment);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    void *map = fstat(fd, &st) == 0 && st.st_size > 0
+                    ? mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)
+                    : MAP_FAILED;
+    close(fd);
+    if (map == MAP_FAILED)
+        return;
+    size_t n = (size_t)st.st_size / sizeof(JournalRecord);
+    for (size_t i = 0; i < n; i++)
     {
-        int l = count_dir(g, x, y, d, p);
-        int r = count_dir(g, x, y, (d + 2) % 4, p); // dy[d] logic is slightly different in original but this works for 4 directions
-        // Re-mapping directions strictly for 4 lines
-        // Original dy was {0, 1, 1, -1}, dy for opposite is {0, -1, -1, 1}
-        // Let's just use 8-direction helper if needed or re-implement count_dir for reverse
+        JournalRecord rec;
+        memcpy(&rec, (const uint8_t *)map + i * sizeof(rec), sizeof(rec));
+        if (rec.check != journal_check(rec))
+            break;
+        replay_record(rec);
     }
-    // Simplified pattern check to match original's spirit
-    g[x][y] = original;
-    return false;
+    munmap(map, (size_t)st.st_size);
 }
 
-// Actually, let's keep the EXACT structure from the user's code for reliability
-struct AI_Board
+// Group commit: every sync_ms (or at once for sync_journal) writes the
+// batch to the open segment and fdatasyncs it. Every snapshot_sec it moves
+// on to a new segment, snapshots, and drops the segments the snapshot
+// covers.
+void run_journal()
 {
-    int g[BOARD_SIZE][BOARD_SIZE];
-    int turn;
-
-    void from_room(int idx)
+    std::vector<JournalRecord> batch;
+    int64_t next_snapshot = now_us() + (int64_t)journal.snapshot_sec * 1000000;
+    std::unique_lock<std::mutex> lock(journal.mutex);
+    for (;;)
     {
-        memset(g, 0, sizeof(g));
-        for (int i = 0; i < rooms[idx].stone_count; ++i)
+        journal.wake.wait_for(lock, std::chrono::milliseconds(journal.sync_ms),
+                              [] { return journal.flush_wanted > journal.flushed; });
+        long long wanted = journal.flush_wanted;
+        bool snapshot = now_us() >= next_snapshot;
+        long long segment = journal.segment;
+        if (snapshot)
+            journal.segment++;
+        for (JournalStripe &stripe : journal.stripes)
         {
-            // AI 1, -1. Room 1 (Black), 2 (White)
-            g[rooms[idx].stones[i].r][rooms[idx].stones[i].c] = (rooms[idx].stones[i].color == 1) ? 1 : -1;
+            std::lock_guard<std::mutex> stripe_lock(stripe.mutex);
+            batch.insert(batch.end(), stripe.pending.begin(), stripe.pending.end());
+            stripe.pending.clear();
         }
-    }
+        lock.unlock();
 
-    bool win_at(int x, int y) const
-    {
-        int p = g[x][y];
-        if (p == 0)
-            return false;
-        for (int d = 0; d < 4; d++)
+        if (!batch.empty())
         {
-            int cnt = 1;
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x + dx[d] * s, ny = y + dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                cnt++;
-            }
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x - dx[d] * s, ny = y - dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                cnt++;
-            }
-            if (cnt >= 5)
-                return true;
+            write_all(journal.fd, batch.data(), batch.size() * sizeof(JournalRecord));
+            fdatasync(journal.fd);
+            batch.clear();
         }
-        return false;
+        if (snapshot)
+        {
+            close(journal.fd);
+            journal.fd = open(journal_path("journal", segment + 1).c_str(),
+                              O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (write_snapshot(segment + 1))
+                for (long long old : list_segments())
+                    if (old <= segment)
+                        unlink(journal_path("journal", old).c_str());
+            next_snapshot = now_us() + (int64_t)journal.snapshot_sec * 1000000;
+        }
+
+        lock.lock();
+        journal.flushed = wanted;
+        journal.flushed_cv.notify_all();
     }
+}
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#define EXPORT __declspec(dllexport)
+#else
+#define EXPORT __attribute__((visibility("default")))
+#endif
 
-    std::vector<int> candidates() const
+extern "C"
+{
+    // Registers a room: 1 created, 0 already exists, -1 out of rooms.
+    EXPORT int create_room(long long room_id)
     {
-        bool near[BOARD_SIZE][BOARD_SIZE]{};
-        bool hasStone = false;
-        for (int i = 0; i < BOARD_SIZE; i++)
-            for (int j = 0; j < BOARD_SIZE; j++)
-                if (g[i][j] != 0)
-                {
-                    hasStone = true;
-                    for (int di = -2; di <= 2; di++)
-                        for (int dj = -2; dj <= 2; dj++)
-                        {
-                            int ni = i + di, nj = j + dj;
-                            if (inside(ni, nj))
-                                near[ni][nj] = true;
-                        }
-                }
-        std::vector<int> res;
-        if (!hasStone)
-        {
-            res.push_back(7 * BOARD_SIZE + 7);
-            return res;
-        }
-        for (int i = 0; i < BOARD_SIZE; i++)
-            for (int j = 0; j < BOARD_SIZE; j++)
-                if (near[i][j] && g[i][j] == 0)
-                    res.push_back(i * BOARD_SIZE + j);
-        return res;
+        return room_registry.create(room_id);
     }
 
-    bool is_open_four(int x, int y, int p)
+    // Unregisters a room and cancels its searches; its memory is reused
+    // once they have stopped. Returns 0 if there was no such room.
+    EXPORT int destroy_room(long long room_id)
     {
-        g[x][y] = p;
-        bool found = false;
-        for (int d = 0; d < 4; d++)
+        int slot = room_registry.remove(room_id);
+        if (slot == -1)
+            return 0;
+        GameRoom *room = room_registry.at(slot);
         {
-            int l = 0;
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x + dx[d] * s, ny = y + dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                l++;
-            }
-            int r = 0;
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x - dx[d] * s, ny = y - dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                r++;
-            }
-            if (l + r + 1 == 4)
-            {
-                // Check ends
-                int lx = x - dx[d] * (r + 1), ly = y - dy[d] * (r + 1);
-                int rx = x + dx[d] * (l + 1), ry = y + dy[d] * (l + 1);
-                if (inside(lx, ly) && g[lx][ly] == 0 && inside(rx, ry) && g[rx][ry] == 0)
-                {
-                    found = true;
-                    break;
-                }
-            }
+            std::lock_guard<std::mutex> lock(ai_pool.mutex);
+            ai_pool.stop_ponder(room);
+            for (AiJob &job : ai_pool.jobs)
+                if (job.state != AI_JOB_FREE && job.room == room)
+                    ai_pool.cancel(&job);
         }
-        g[x][y] = 0;
-        return found;
+        std::lock_guard<std::mutex> lock(ai_mutex);
+        room->live = false;
+        retire_room(room);
+        return 1;
     }
 
-    bool is_open_three(int x, int y, int p)
+    // Creates the room on first use.
+    EXPORT void init_game(long long room_id)
     {
-        g[x][y] = p;
-        bool found = false;
-        for (int d = 0; d < 4; d++)
-        {
-            int l = 0;
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x + dx[d] * s, ny = y + dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                l++;
-            }
-            int r = 0;
-            for (int s = 1; s < 5; s++)
-            {
-                int nx = x - dx[d] * s, ny = y - dy[d] * s;
-                if (!inside(nx, ny) || g[nx][ny] != p)
-                    break;
-                r++;
-            }
-            if (l + r + 1 == 3)
-            {
-                int lx = x - dx[d] * (r + 1), ly = y - dy[d] * (r + 1);
-                int rx = x + dx[d] * (l + 1), ry = y + dy[d] * (l + 1);
-                if (inside(lx, ly) && g[lx][ly] == 0 && inside(rx, ry) && g[rx][ry] == 0)
-                {
-                    found = true;
-                    break;
-                }
-            }
-        }
-        g[x][y] = 0;
-        return found;
+        create_room(room_id);
     }
 
-    bool threat_search(int depth)
+    // Players per room (get_state's players_buffer needs 3 ints each);
+    // applies to rooms created afterwards.
+    EXPORT void set_player_capacity(int n)
     {
-        if (depth == 0)
-            return false;
-        const int p = turn;
-        for (int m : candidates())
-        {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            if (!is_open_four(x, y, p) && !is_open_three(x, y, p))
-                continue;
-            g[x][y] = p;
-            if (win_at(x, y))
-            {
-                g[x][y] = 0;
-                return true;
-            }
-            bool blocked = false;
-            turn = -turn;
-            for (int r_move : candidates())
-            {
-                int rx = r_move / BOARD_SIZE, ry = r_move % BOARD_SIZE;
-                g[rx][ry] = turn;
-                turn = -turn;
-                if (!threat_search(depth - 1))
-                    blocked = true;
-                turn = -turn;
-                g[rx][ry] = 0;
-                if (blocked)
-                    break;
-            }
-            turn = -turn;
-            g[x][y] = 0;
-            if (!blocked)
-                return true;
-        }
-        return false;
+        player_capacity = std::max(1, n);
     }
 
-    int evaluate()
+    // Per-room transposition table budget in MiB; 0 disables the table.
+    EXPORT void set_tt_size_mb(int mb)
     {
-        int score = 0;
-        const int p = turn;
-        for (int m : candidates())
-        {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            if (is_open_four(x, y, p))
-                score += 100000;
-            if (is_open_three(x, y, p))
-                score += 10000;
-        }
-        return score;
+        tt_budget_bytes = mb > 0 ? (size_t)mb << 20 : 0;
     }
 
-    int negamax(int depth, int alpha, int beta)
+    // Node budget of each threat-space (VCF/VCT) solve inside get_ai_move.
+    EXPORT void set_threat_node_limit(int nodes)
     {
-        if (depth == 0)
-            return evaluate();
-        for (int m : candidates())
-        {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            g[x][y] = turn;
-            turn = -turn;
-            int v = -negamax(depth - 1, -beta, -alpha);
-            turn = -turn;
-            g[x][y] = 0;
-            alpha = std::max(alpha, v);
-            if (alpha >= beta)
-                break;
-        }
-        return alpha;
+        threat_node_limit = nodes > 0 ? (uint64_t)nodes : 0;
     }
-};
 
-#if defined(_WIN32) || defined(_WIN64)
-#define EXPORT __declspec(dllexport)
-#else
-#define EXPORT __attribute__((visibility("default")))
-#endif
+    // Threads per AI search (main + Lazy SMP helpers), clamped to 1..64.
+    EXPORT void set_ai_threads(int n)
+    {
+        ai_threads = std::max(1, std::min(n, 64));
+    }
 
-extern "C"
-{
-    EXPORT void init_game(int room_id)
+    EXPORT void set_ai_move_ordering(int on)
     {
-        int idx = room_id % MAX_ROOMS;
+        ai_move_ordering = on != 0;
     }
 
-    EXPORT void reset_game(int room_id)
+    EXPORT void reset_game(long long room_id)
     {
-        int idx = room_id % MAX_ROOMS;
-        rooms[idx].stone_count = 0;
-        rooms[idx].can_place_color = 1;
-        for (int i = 0; i < MAX_PLAYERS; ++i)
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
+            return;
         {
-            if (rooms[idx].players[i].active)
-            {
-                rooms[idx].players[i].r = BOARD_SIZE / 2;
-                rooms[idx].players[i].c = BOARD_SIZE / 2;
-            }
+            // Searches on the old position are of no use to anyone.
+            std::lock_guard<std::mutex> lock(ai_pool.mutex);
+            ai_pool.stop_ponder(room);
+            for (AiJob &job : ai_pool.jobs)
+                if (job.state != AI_JOB_FREE && job.room == room)
+                    ai_pool.cancel(&job);
+        }
+        RoomWrite w(room, room_id);
+        if (!w.valid)
+            return;
+        clear_board(room);
+        log_change(room, CHANGE_RESET);
+        PlayerTable &pt = *room->players;
+        for (int i = 0; i < pt.count; ++i)
+        {
+            Player &p = pt.slots[pt.active[i]];
+            p.r = BOARD_SIZE / 2;
+            p.c = BOARD_SIZE / 2;
         }
+        journal_room(room, JR_RESET);
     }
 
-    EXPORT void move_player(int room_id, int player_id, int dx_in, int dy_in, int *out_r, int *out_c)
+    EXPORT void move_player(long long room_id, int player_id, int dx_in, int dy_in, int *out_r, int *out_c)
     {
-        int idx = room_id % MAX_ROOMS;
-        GameRoom *room = &rooms[idx];
-        Player *p = nullptr;
-        for (int i = 0; i < MAX_PLAYERS; ++i)
-        {
-            if (room->players[i].active && room->players[i].id == player_id)
-            {
-                p = &room->players[i];
-                break;
-            }
-        }
-        if (!p)
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
         {
-            for (int i = 0; i < MAX_PLAYERS; ++i)
-            {
-                if (!room->players[i].active)
-                {
-                    p = &room->players[i];
-                    p->active = true;
-                    p->id = player_id;
-                    p->r = BOARD_SIZE / 2;
-                    p->c = BOARD_SIZE / 2;
-                    break;
-                }
-            }
+            *out_r = 0;
+            *out_c = 0;
+            return;
         }
+        RoomWrite w(room, room_id);
+        Player *p = w.valid ? room->players->find(player_id) : nullptr;
+        bool joined = !p && w.valid && (p = room->players->add(player_id));
+        if (joined)
+            log_change(room, CHANGE_PLAYER, player_id);
         if (p)
         {
             int nr = p->r + dy_in;
             int nc = p->c + dx_in;
-            if (inside(nr, nc))
+            bool moved = inside(nr, nc) && (dx_in || dy_in);
+            if (moved)
             {
                 p->r = nr;
                 p->c = nc;
+                log_change(room, CHANGE_PLAYER, player_id);
+                mark_dirty(room);
             }
+            if (joined) // cursor moves alone are not journaled (see Journal)
+                journal_room(room, JR_MOVE, player_id, moved ? dx_in : 0, moved ? dy_in : 0);
             *out_r = p->r;
             *out_c = p->c;
         }
@@ -400,155 +3095,493 @@ extern "C"
         }
     }
 
-    EXPORT bool place_stone(int room_id, int r, int c, int color)
+    // Drops a player from the room; its slot is reused by later joiners.
+    EXPORT int remove_player(long long room_id, int player_id)
+    {
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
+            return 0;
+        RoomWrite w(room, room_id);
+        if (!w.valid || !room->players->remove(player_id))
+            return 0;
+        log_change(room, CHANGE_PLAYER, player_id);
+        mark_dirty(room);
+        journal_room(room, JR_REMOVE, player_id);
+        return 1;
+    }
+
+    EXPORT bool place_stone(long long room_id, int r, int c, int color)
     {
-        int idx = room_id % MAX_ROOMS;
-        GameRoom *room = &rooms[idx];
-        if (room->stone_count >= MAX_STONES)
+        if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE)
             return false;
-        for (int i = 0; i < room->stone_count; ++i)
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
+            return false;
+        if (room->ponder_ticket.load(std::memory_order_relaxed))
         {
-            if (room->stones[i].r == r && room->stones[i].c == c)
-                return false;
+            std::lock_guard<std::mutex> lock(ai_pool.mutex);
+            ai_pool.stop_ponder(room);
         }
+        RoomWrite w(room, room_id);
+        int m = r * BOARD_SIZE + c;
+        if (!w.valid || room->stone_count >= MAX_STONES || room->grid[m])
+            return false;
         if (color != room->can_place_color)
         {
             return false;
         }
+        log_change(room, CHANGE_STONE);
         room->stones[room->stone_count].r = r;
         room->stones[room->stone_count].c = c;
         room->stones[room->stone_count].color = color;
         room->stone_count++;
+        room->grid[m] = (uint8_t)color;
+        if (AI_Board *b = room->ai.load(std::memory_order_relaxed))
+            b->play(m, color == 1 ? 1 : -1);
         if (room->can_place_color == 1)
             room->can_place_color = 2;
         else
             room->can_place_color = 1;
+        journal_room(room, JR_PLACE, 0, r, c, color);
         return true;
     }
 
-    EXPORT void get_ai_move(int room_id, int color, int *out_r, int *out_c)
+    EXPORT void get_ai_move(long long room_id, int color, int *out_r, int *out_c)
     {
-        int idx = room_id % MAX_ROOMS;
+        GameRoom *room = room_registry.find(room_id);
         AI_Board b;
-        b.from_room(idx);
-        b.turn = (color == 1) ? 1 : -1;
-
         int best_move = -1;
-        // 1. Immediate win
-        for (int m : b.candidates())
+        if (room && begin_search(b, room, room_id))
         {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            b.g[x][y] = b.turn;
-            if (b.win_at(x, y))
-            {
-                best_move = m;
-                b.g[x][y] = 0;
-                break;
-            }
-            b.g[x][y] = 0;
+            b.from_room(room);
+            b.turn = (color == 1) ? 1 : -1;
+            int depth;
+            best_move = b.choose_move(3, 3, depth);
+            AI_STAT(record_search(room, b, best_move, depth);)
+            end_search(room);
         }
         if (best_move != -1)
         {
             *out_r = best_move / BOARD_SIZE;
             *out_c = best_move % BOARD_SIZE;
-            return;
         }
+        else
+        {
+            *out_r = 7;
+            *out_c = 7;
+        } // Default center
+    }
 
-        // 2. Block immediate opponent win
-        int op_turn = -b.turn;
-        for (int m : b.candidates())
+    // Like get_ai_move, but deepens iteratively until budget_us elapses and
+    // returns the best move of the last completed iteration.
+    EXPORT void get_ai_move_timed(long long room_id, int color, int budget_us, int *out_r, int *out_c,
+                                  int *out_depth, long long *out_nodes)
+    {
+        GameRoom *room = room_registry.find(room_id);
+        AI_Board b;
+        int best_move = -1;
+        *out_depth = 0;
+        if (room && begin_search(b, room, room_id))
         {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            b.g[x][y] = op_turn;
-            if (b.win_at(x, y))
-            {
-                best_move = m;
-                b.g[x][y] = 0;
-                break;
-            }
-            b.g[x][y] = 0;
+            b.from_room(room);
+            b.turn = (color == 1) ? 1 : -1;
+            b.deadline_us = now_us() + std::max(budget_us, 1);
+            best_move = b.choose_move(1, AI_MAX_DEPTH, *out_depth);
+            AI_STAT(record_search(room, b, best_move, *out_depth);)
+            end_search(room);
         }
+        *out_nodes = (long long)b.nodes;
         if (best_move != -1)
         {
             *out_r = best_move / BOARD_SIZE;
             *out_c = best_move % BOARD_SIZE;
+        }
+        else
+        {
+            *out_r = 7;
+            *out_c = 7;
+        } // Default center
+    }
+
+    // Queues a timed search (budget counted from now) and returns its ticket,
+    // or -1 if MAX_AI_JOBS searches are already outstanding. The search sees
+    // every room command submitted before the call.
+    EXPORT long long ai_begin(long long room_id, int color, int budget_us)
+    {
+        wait_room_commands(room_id);
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
+            return -1;
+        std::lock_guard<std::mutex> lock(ai_pool.mutex);
+        ai_pool.stop_ponder(room);
+        long long ticket = ai_pool.submit(room, room_id, color, budget_us, false);
+        if (ticket != -1 && ai_pool.idle < ai_pool.count)
+        {
+            // No free worker: take one back from some other room's ponder.
+            for (AiJob &job : ai_pool.jobs)
+                if (job.ponder && job.state == AI_JOB_RUNNING && !job.cancel.load(std::memory_order_relaxed))
+                {
+                    ai_pool.stop_ponder(job.room);
+                    break;
+                }
+        }
+        return ticket;
+    }
+
+    // Thinks on the opponent's time: searches the room's position with the
+    // opponent of ai_color to move, until the next stone, reset or ai_begin
+    // in the room. The replies' subtrees land in the room's table, so the
+    // following search finds them there. Only uses an otherwise idle worker.
+    EXPORT void ai_ponder(long long room_id, int ai_color)
+    {
+        GameRoom *room = room_registry.find(room_id);
+        if (!ai_pondering || !room)
+            return;
+        std::lock_guard<std::mutex> lock(ai_pool.mutex);
+        ai_pool.stop_ponder(room);
+        if (ai_pool.workers > 0 && ai_pool.idle <= ai_pool.count)
             return;
+        long long ticket = ai_pool.submit(room, room_id, ai_color == 1 ? 2 : 1, 0, true);
+        if (ticket != -1)
+            room->ponder_ticket.store(ticket, std::memory_order_relaxed);
+    }
+
+    EXPORT void set_ai_ponder(int on)
+    {
+        ai_pondering = on != 0;
+    }
+
+    // AI_POLL_PENDING (progress in out_depth/out_nodes), AI_POLL_DONE (move in
+    // out_r/out_c), AI_POLL_CANCELLED or AI_POLL_UNKNOWN. A finished ticket is
+    // released by the poll that reports it.
+    EXPORT int ai_poll(long long ticket, int *out_r, int *out_c, int *out_depth, long long *out_nodes)
+    {
+        std::lock_guard<std::mutex> lock(ai_pool.mutex);
+        AiJob *job = ai_pool.find(ticket);
+        if (!job || job->detached)
+            return AI_POLL_UNKNOWN;
+        *out_depth = job->progress.depth.load(std::memory_order_relaxed);
+        *out_nodes = job->progress.nodes.load(std::memory_order_relaxed);
+        if (job->state == AI_JOB_QUEUED || job->state == AI_JOB_RUNNING)
+            return AI_POLL_PENDING;
+        int status = AI_POLL_CANCELLED;
+        if (job->state == AI_JOB_DONE)
+        {
+            status = AI_POLL_DONE;
+            *out_r = job->move != -1 ? job->move / BOARD_SIZE : 7;
+            *out_c = job->move != -1 ? job->move % BOARD_SIZE : 7;
+            *out_nodes = (long long)job->board.nodes;
         }
+        ai_pool.release(job);
+        return status;
+    }
+
+    // Stops a search; the ticket is invalid afterwards.
+    EXPORT void ai_cancel(long long ticket)
+    {
+        std::lock_guard<std::mutex> lock(ai_pool.mutex);
+        if (AiJob *job = ai_pool.find(ticket))
+            ai_pool.cancel(job);
+    }
+
+    // Size of the AI worker pool; it only grows.
+    EXPORT void set_ai_workers(int n)
+    {
+        std::lock_guard<std::mutex> lock(ai_pool.mutex);
+        ai_pool.target_workers = std::max(1, std::min(n, 64));
+        if (ai_pool.workers > 0)
+            ai_pool.ensure_workers();
+    }
+
+    // Statistics of the room's last finished search (ponder jobs excluded):
+    // 1 filled in, 0 unknown room or no search yet, -1 built without AI_STATS.
+    EXPORT int get_ai_stats(long long room_id, AiStats *out)
+    {
+#ifdef AI_STATS
+        GameRoom *room = room_registry.find(room_id);
+        if (!room)
+            return 0;
+        std::lock_guard<std::mutex> lock(room->lock);
+        *out = room->ai_stats;
+        return out->phase != -1;
+#else
+        (void)room_id;
+        (void)out;
+        return -1;
+#endif
+    }
+
+    // Copies up to cap buckets of the search latency histogram (see
+    // ai_latency_hist) and returns how many, or -1 without AI_STATS.
+    EXPORT int get_ai_latency_histogram(long long *out, int cap)
+    {
+#ifdef AI_STATS
+        int n = std::max(0, std::min(cap, AI_HIST_BUCKETS));
+        for (int i = 0; i < n; i++)
+            out[i] = (long long)ai_latency_hist[i].load(std::memory_order_relaxed);
+        return n;
+#else
+        (void)out;
+        (void)cap;
+        return -1;
+#endif
+    }
 
-        // 3. Threat search (VCT)
-        for (int m : b.candidates())
+    // Starts n room shards (clamped to 1..MAX_SHARDS) and returns how many
+    // run. Only the first call counts: moving rooms to other shards later
+    // could reorder their commands.
+    EXPORT int set_room_shards(int n)
+    {
+        std::lock_guard<std::mutex> lock(shard_start_mutex);
+        if (shard_count.load(std::memory_order_relaxed) == 0)
         {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            b.g[x][y] = b.turn;
-            if (b.threat_search(2))
+            n = std::max(1, std::min(n, MAX_SHARDS));
+            for (int i = 0; i < n; i++)
             {
-                best_move = m;
-                b.g[x][y] = 0;
-                break;
+                shards[i] = new Shard();
+                std::thread(run_shard, shards[i]).detach();
             }
-            b.g[x][y] = 0;
+            shard_count.store(n, std::memory_order_release);
         }
-        if (best_move != -1)
+        return shard_count.load(std::memory_order_relaxed);
+    }
+
+    // Queues a command (RoomCommandKind) for the room's shard: 1 queued, 0
+    // the shard is full (drop or retry). Commands for a room run in the
+    // order they were submitted; applied stones and resets mark the room
+    // urgent for next_tick, cursor moves mark it dirty. A command is only
+    // applied to the room that held room_id when it was queued; destroying
+    // the room drops what is still queued for it. Without shards the
+    // command runs right away on the calling thread.
+    EXPORT int submit_room_command(long long room_id, int kind, int player_id, int a, int b, int color)
+    {
+        RoomCommand cmd = {room_id, kind, player_id, a, b, color, -1};
+        if (GameRoom *room = room_registry.find(room_id))
+            read_room(room, room_id, [&]() { cmd.epoch = room->epoch; });
+        int n = shard_count.load(std::memory_order_acquire);
+        if (n == 0)
         {
-            *out_r = best_move / BOARD_SIZE;
-            *out_c = best_move % BOARD_SIZE;
-            return;
+            apply_command(cmd);
+            return 1;
         }
-
-        // 4. Negamax
-        int best_val = -INF;
-        for (int m : b.candidates())
+        Shard *shard = shards[RoomRegistry::hash(room_id) % n];
+        if (!shard->queue.push(cmd))
+            return 0;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (shard->sleeping.load(std::memory_order_relaxed))
         {
-            int x = m / BOARD_SIZE, y = m % BOARD_SIZE;
-            b.g[x][y] = b.turn;
-            b.turn = -b.turn;
-            int v = -b.negamax(2, -INF, INF);
-            b.turn = -b.turn;
-            b.g[x][y] = 0;
-            if (v > best_val)
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->wake.notify_one();
+        }
+        return 1;
+    }
+
+    // Makes rooms durable in dir (created if missing): restores the rooms
+    // saved there (snapshot plus journal), writes a fresh snapshot, then
+    // journals every change from now on. Call once, before serving, after
+    // set_player_capacity. Returns the number of rooms restored, or -1 if
+    // the journal is already open or not supported on this platform.
+    EXPORT int open_journal(const char *dir)
+    {
+#ifdef HAVE_JOURNAL
+        if (journal.active.load() || journal.fd != -1)
+            return -1;
+        mkdir(dir, 0755);
+        journal.dir = dir;
+        long long base = load_snapshot();
+        long long segment = base;
+        for (long long n : list_segments())
+            if (n >= base)
             {
-                best_val = v;
-                best_move = m;
+                replay_segment(n);
+                segment = n + 1;
             }
+        advance_recovered_versions();
+        journal.fd = open(journal_path("journal", segment).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (journal.fd < 0)
+            return -1;
+        journal.segment = segment;
+        if (write_snapshot(segment))
+            for (long long old : list_segments())
+                if (old < segment)
+                    unlink(journal_path("journal", old).c_str());
+        int rooms;
+        {
+            std::shared_lock<std::shared_mutex> lock(room_registry.mutex);
+            rooms = (int)room_registry.used;
         }
+        journal.active.store(true);
+        std::thread(run_journal).detach();
+        return rooms;
+#else
+        (void)dir;
+        return -1;
+#endif
+    }
 
-        if (best_move != -1)
+    // Group commit interval and snapshot period; set before open_journal.
+    EXPORT void set_journal_sync_ms(int ms)
+    {
+        journal.sync_ms = std::max(1, ms);
+    }
+
+    EXPORT void set_journal_snapshot_sec(int sec)
+    {
+        journal.snapshot_sec = std::max(1, sec);
+    }
+
+    // Blocks until every change made before the call is on disk.
+    EXPORT void sync_journal()
+    {
+        if (!journal.active.load())
+            return;
+        std::unique_lock<std::mutex> lock(journal.mutex);
+        long long wanted = ++journal.flush_wanted;
+        journal.wake.notify_one();
+        journal.flushed_cv.wait(lock, [wanted] { return journal.flushed >= wanted; });
+    }
+
+    // Maps a book written by tools/book_gen.cpp and answers early positions
+    // from it from now on; returns its entry count, or -1 if the file is
+    // missing or malformed (the current book stays). An empty path drops
+    // the book.
+    EXPORT int load_opening_book(const char *path)
+    {
+        if (!path || !*path)
         {
-            *out_r = best_move / BOARD_SIZE;
-            *out_c = best_move % BOARD_SIZE;
+            opening_book.store(nullptr, std::memory_order_release);
+            return 0;
         }
-        else
+#ifdef HAVE_MMAP
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        struct stat st;
+        void *map = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(BookHeader)
+                        ? mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)
+                        : MAP_FAILED;
+        close(fd);
+        if (map == MAP_FAILED)
+            return -1;
+        BookHeader head;
+        memcpy(&head, map, sizeof(head));
+        if (memcmp(head.magic, BOOK_MAGIC, sizeof(head.magic)) != 0 ||
+            head.count > ((size_t)st.st_size - sizeof(BookHeader)) / sizeof(BookEntry))
         {
-            *out_r = 7;
-            *out_c = 7;
-        } // Default center
+            munmap(map, (size_t)st.st_size);
+            return -1;
+        }
+        OpeningBook *book = new OpeningBook;
+        book->entries = (const BookEntry *)((const uint8_t *)map + sizeof(BookHeader));
+        book->count = (size_t)head.count;
+        opening_book.store(book, std::memory_order_release);
+        return (int)book->count;
+#else
+        return -1;
+#endif
     }
 
-    EXPORT void get_state(int room_id, int *players_buffer, int *out_p_count, int *stones_buffer, int *out_s_count)
+    EXPORT void get_state(long long room_id, int *players_buffer, int *out_p_count, int *stones_buffer, int *out_s_count)
     {
-        int idx = room_id % MAX_ROOMS;
-        GameRoom *room = &rooms[idx];
-        int p_idx = 0, active_count = 0;
-        for (int i = 0; i < MAX_PLAYERS; ++i)
+        // Never blocks: a snapshot torn by a concurrent writer is retaken.
+        GameRoom *room = room_registry.find(room_id);
+        if (!room ||
+            !read_room(room, room_id, [&]() {
+                copy_state(room, players_buffer, room->players->capacity, out_p_count, stones_buffer, out_s_count);
+            }))
         {
-            if (room->players[i].active)
-            {
-                players_buffer[p_idx++] = room->players[i].id;
-                players_buffer[p_idx++] = room->players[i].r;
-                players_buffer[p_idx++] = room->players[i].c;
-                active_count++;
-            }
+            *out_p_count = 0;
+            *out_s_count = 0;
+            stones_buffer[0] = 1;
         }
-        *out_p_count = active_count;
-        int s_idx = 0;
-        for (int i = 0; i < room->stone_count; ++i)
+    }
+
+    // Like get_state, but only what changed after `since` (a version this
+    // call returned before): players added, moved or removed as (id, r, c),
+    // with r = c = -1 for removed ones, and the stones appended, followed by
+    // the colour to move. Returns 1 instead with a full get_state snapshot
+    // when since < 0 or the room's change log no longer reaches back to it.
+    // *out_version is the version the result brings the caller up to.
+    EXPORT int get_state_since(long long room_id, long long since, int *players_buffer, int *out_p_count,
+                               int *stones_buffer, int *out_s_count, long long *out_version)
+    {
+        return state_since(room_id, since, players_buffer, -1, out_p_count, stones_buffer, out_s_count, out_version);
+    }
+
+    // Broadcast tick rate for batched cursor updates, clamped to 1..1000 Hz.
+    EXPORT void set_tick_hz(int hz)
+    {
+        std::lock_guard<std::mutex> lock(ticks.mutex);
+        ticks.interval_us = 1000000 / std::max(1, std::min(hz, 1000));
+    }
+
+    // Waits for the next tick and returns up to cap ids of rooms whose
+    // cursors changed since their last tick, clearing their dirty flags;
+    // send each one update (get_state_frame). Rooms beyond cap come out on
+    // the next call without waiting, and a room marked urgent ends the wait
+    // early without moving the tick schedule. Meant for a single ticking
+    // thread.
+    EXPORT int next_tick(long long *out_ids, int cap)
+    {
+        int64_t now = now_us();
+        std::unique_lock<std::mutex> lock(ticks.mutex);
+        if (!ticks.backlog && !ticks.urgent)
         {
-            stones_buffer[s_idx++] = room->stones[i].r;
-            stones_buffer[s_idx++] = room->stones[i].c;
-            stones_buffer[s_idx++] = room->stones[i].color;
+            int64_t wake = std::max(ticks.next_us + ticks.interval_us, now);
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(wake - now);
+            if (!ticks.wake.wait_until(lock, deadline, [] { return ticks.urgent; }))
+                ticks.next_us = wake;
         }
-        // Append the currently allowed color to place (1=Black, 2=White)
-        stones_buffer[s_idx++] = room->can_place_color;
-        *out_s_count = room->stone_count;
+        ticks.urgent = false;
+        int n = std::min(cap, (int)ticks.dirty.size());
+        std::copy(ticks.dirty.begin(), ticks.dirty.begin() + n, out_ids);
+        ticks.dirty.erase(ticks.dirty.begin(), ticks.dirty.begin() + n);
+        ticks.backlog = !ticks.dirty.empty();
+        lock.unlock();
+        for (int i = 0; i < n; i++)
+            if (GameRoom *room = room_registry.find(out_ids[i]))
+                room->dirty.store(false, std::memory_order_release);
+        return n;
+    }
+
+    // get_state_since as a ready-to-send frame (see Wire frames in
+    // game_logic.h). Returns its length, or -1 if cap is below
+    // FRAME_MAX_BYTES for the room.
+    EXPORT int get_state_frame(long long room_id, long long since, unsigned char *buf, int cap, long long *out_version)
+    {
+        static thread_local std::vector<int> p_buf;
+        int s_buf[MAX_STONES * 3 + 1];
+        int p_count, s_count, full;
+        // The room's table is only sized here, outside the read; a join or
+        // a recreated room may have grown it by then, so retry until it fits.
+        do
+        {
+            GameRoom *room = room_registry.find(room_id);
+            int players = room ? room->players->capacity : 0;
+            if (cap < FRAME_MAX_BYTES(players))
+                return -1;
+            p_buf.resize(players * 3 + 3);
+            full = state_since(room_id, since, p_buf.data(), players, &p_count, s_buf, &s_count, out_version);
+        } while (full < 0);
+
+        uint8_t *p = buf;
+        *p++ = FRAME_FORMAT;
+        *p++ = full ? FRAME_FULL : 0;
+        *p++ = (uint8_t)s_buf[s_count * 3];
+        p = put_varint(p, (uint64_t)*out_version);
+        if (!full)
+            p = put_varint(p, (uint64_t)since);
+        p = put_varint(p, (uint64_t)p_count);
+        for (int i = 0; i < p_count; i++)
+        {
+            p = put_varint(p, (uint32_t)p_buf[i * 3]);
+            bool gone = p_buf[i * 3 + 1] < 0;
+            *p++ = gone ? FRAME_GONE : (uint8_t)p_buf[i * 3 + 1];
+            *p++ = gone ? FRAME_GONE : (uint8_t)p_buf[i * 3 + 2];
+        }
+        p = put_varint(p, (uint64_t)s_count);
+        for (int i = 0; i < s_count; i++)
+            p = put_varint(p, (uint64_t)(s_buf[i * 3] * BOARD_SIZE + s_buf[i * 3 + 1]));
+        return (int)(p - buf);
     }
 }
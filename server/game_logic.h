@@ -0,0 +1,58 @@
+// Native interface of game_logic.cpp for programs that link against
+// game_logic.so (server.cpp) instead of compiling the engine into
+// themselves, so the room store lives in one place. app.py binds the same
+// exports through ctypes. game_logic.cpp includes this header, so the
+// declarations below cannot drift from the definitions.
+#pragma once
+
+#include <cstdint>
+
+#define BOARD_SIZE 15
+#define MAX_PLAYERS 50
+#define MAX_STONES 256
+
+// --- Wire frames ---------------------------------------------------------
+// get_state_frame packs what get_state_since returns into the bytes sent to
+// clients as is:
+//   u8 FRAME_FORMAT, u8 flags (FRAME_FULL), u8 colour to move,
+//   varint version, varint base (deltas only),
+//   varint players, per player: varint id, u8 r, u8 c (FRAME_GONE both if removed),
+//   varint stones, per stone: varint r * BOARD_SIZE + c.
+// Stone colours are implied: stones alternate from black.
+#define FRAME_FORMAT 1
+#define FRAME_FULL 1
+#define FRAME_GONE 255
+#define FRAME_MAX_BYTES(players) (3 + 2 * 10 + 5 + (players) * 7 + 5 + MAX_STONES * 2)
+
+inline uint8_t *put_varint(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Kinds for submit_room_command (see Room shards in game_logic.cpp).
+enum RoomCommandKind
+{
+    ROOM_CMD_MOVE,   // a, b: dx, dy
+    ROOM_CMD_PLACE,  // a, b: r, c, or the player's cursor if a < 0; color
+    ROOM_CMD_RESET,
+    ROOM_CMD_REMOVE
+};
+
+// The exports server.cpp uses; see their definitions for the details.
+extern "C"
+{
+    void init_game(long long room_id);
+    int destroy_room(long long room_id);
+    void move_player(long long room_id, int player_id, int dx_in, int dy_in, int *out_r, int *out_c);
+    int set_room_shards(int n);
+    int submit_room_command(long long room_id, int kind, int player_id, int a, int b, int color);
+    void set_tick_hz(int hz);
+    int next_tick(long long *out_ids, int cap);
+    int get_state_frame(long long room_id, long long since, unsigned char *buf, int cap, long long *out_version);
+}
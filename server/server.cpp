@@ -1,178 +1,556 @@
-#include <iostream>
-#include <vector>
-#include <string>
-#include <sstream>
-#include <thread>
-#include <mutex>
-#include <map>
-#include <winsock2.h>
-#include <ws2tcpip.h>
+// Native realtime server for Linux: N epoll reactors, each with its own
+// SO_REUSEPORT listener, non-blocking sockets and per-connection buffers.
+// Room changes go to the room shards of game_logic.cpp
+// (submit_room_command); frames are read from the room store directly.
+// 컴파일 : bash build_native.sh server  (links game_logic.so, which it builds)
+// 실행 : ./server [port] [reactors] [shards]
+//
+// Clients send text lines:
+//   JOIN <room>        join a room (created on first use)
+//   MOVE <dy> <dx>     move the cursor
+//   PLACE [<r> <c>]    place a stone at r,c or under the cursor
+//   RESET              clear the board
+//   PING <token>       answered with MSG_PONG right away
+// and receive messages of u8 type, u16 length (LE), payload:
+//   MSG_WELCOME  varint player id, u8 colour (1 black, 2 white, 0 watching)
+//   MSG_FRAME    a get_state_frame frame: full after JOIN, deltas after that
+//   MSG_PONG     varint token
+// Stones, resets and joins reach every member at once; cursor moves go out
+// once per tick (set_tick_hz) merged per room. Commands that find their
+// shard's queue full are dropped.
+#include "game_logic.h"
 
-#pragma comment(lib, "ws2_32.lib")
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #define PORT 5000
-#define BOARD_SIZE 16
+#define MAX_REACTORS 64
+#define IN_BUF 4096
+#define MAX_LINE 256
+#define OUT_CHUNKS 256
+#define IOV_BATCH 64
+#define CHUNK_BYTES (FRAME_MAX_BYTES(MAX_PLAYERS) + 3)
+#define TICK_HZ 30
 
-struct Point {
-    int r, c;
+enum MessageType {
+    MSG_WELCOME = 1,
+    MSG_FRAME = 2,
+    MSG_PONG = 3
 };
 
-// Global State
-std::mutex state_mutex;
-std::map<int, Point> players; // socket_fd -> Position
-std::vector<std::pair<Point, int>> stones; // {{r,c}, color_type} (1=Black, 2=White)
-// Simple color assignment based on join order (odd=Black, even=White for simplicity, or just tracking count)
-int player_count = 0;
+// One outgoing message. A room update is serialised once into a chunk that
+// is queued on every member's connection; whoever drops the last reference
+// hands it back to the reactor's pool. Chunks never leave the reactor that
+// built them, so the count is a plain int.
+struct Chunk {
+    int refs;
+    uint32_t len;
+    Chunk *next_free;
+    uint8_t data[CHUNK_BYTES];
+};
 
-std::string serialize_state() {
-    std::stringstream ss;
-    ss << "STATE";
-    
-    // Players
-    ss << " PLAYERS " << players.size();
-    for (const auto& p : players) {
-        // format: id:r:c
-        ss << " " << p.first << ":" << p.second.r << ":" << p.second.c;
-    }
+enum CommandOp {
+    CMD_UNKNOWN,
+    CMD_JOIN,
+    CMD_MOVE,
+    CMD_PLACE,
+    CMD_RESET,
+    CMD_PING
+};
 
-    // Stones
-    ss << " STONES " << stones.size();
-    for (const auto& s : stones) {
-        // format: r:c:color
-        ss << " " << s.first.r << ":" << s.first.c << ":" << s.second;
-    }
+struct Command {
+    int op;
+    int args;
+    long long arg[2];
+};
 
-    ss << "\n";
-    return ss.str();
-}
+struct Conn {
+    int fd;
+    int reactor;
+    long long room = -1;
+    int player;
+    int color = 0;
+    long long version = -1; // room state version this client holds
+    bool want_write = false;
+    uint32_t in_len = 0;
+    uint32_t in_scanned = 0; // leading bytes of in[] known to hold no newline
+    uint8_t in[IN_BUF];
+    uint32_t out_head = 0, out_tail = 0;
+    uint32_t out_offset = 0; // bytes of out[out_head] already sent
+    Chunk *out[OUT_CHUNKS];
+};
 
-void broadcast(const std::string& msg, const std::vector<SOCKET>& clients) {
-    for (SOCKET client : clients) {
-        send(client, msg.c_str(), msg.length(), 0);
-    }
-}
+// Which reactors have members in a room, and who sits at the board.
+struct RoomDir {
+    int members[MAX_REACTORS] = {};
+    uint64_t reactors = 0;
+    int black = -1, white = -1;
+    int total = 0;
+};
 
-void handle_client(SOCKET client_socket, int id, std::vector<SOCKET>& all_clients) {
-    char buffer[1024];
-    int color = (player_count % 2 == 0) ? 1 : 2; // Simple assignment
-    player_count++;
+std::mutex dir_mutex;
+std::unordered_map<long long, RoomDir> room_dir;
+std::atomic<int> next_player_id{1};
 
+struct Reactor {
+    int id;
+    int epfd;
+    int listen_fd;
+    int wake_fd;
+    std::thread thread;
+    std::mutex inbox_mutex;
+    std::vector<long long> inbox; // rooms to send updates for
+    std::vector<long long> inbox_spare; // swapped with inbox to keep its capacity; reactor thread only
+    std::unordered_map<long long, std::vector<Conn *>> members;
+    Chunk *free_chunks = nullptr;
+};
+
+Reactor reactors[MAX_REACTORS];
+int reactor_count = 1;
+
+// Listener and wake-up fds are told apart from connections by these tags.
+static uint8_t listen_tag, wake_tag;
+
+void post_update(long long room_id) {
+    uint64_t mask;
     {
-        std::lock_guard<std::mutex> lock(state_mutex);
-        players[id] = {BOARD_SIZE / 2, BOARD_SIZE / 2};
+        std::lock_guard<std::mutex> lock(dir_mutex);
+        auto it = room_dir.find(room_id);
+        if (it == room_dir.end())
+            return;
+        mask = it->second.reactors;
     }
+    for (int i = 0; i < reactor_count; i++) {
+        if (!(mask >> i & 1))
+            continue;
+        Reactor &r = reactors[i];
+        bool was_empty;
+        {
+            std::lock_guard<std::mutex> lock(r.inbox_mutex);
+            was_empty = r.inbox.empty();
+            r.inbox.push_back(room_id);
+        }
+        if (was_empty) {
+            uint64_t one = 1;
+            (void)!write(r.wake_fd, &one, sizeof(one));
+        }
+    }
+}
 
-    std::cout << "Client " << id << " connected. Color: " << color << std::endl;
+static void watch(Reactor &r, Conn *c) {
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | (c->want_write ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = c;
+    epoll_ctl(r.epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
 
-    while (true) {
-        int bytes_received = recv(client_socket, buffer, 1024, 0);
-        if (bytes_received <= 0) break;
+static Chunk *new_chunk(Reactor &r) {
+    Chunk *k = r.free_chunks;
+    if (k)
+        r.free_chunks = k->next_free;
+    else
+        k = new Chunk();
+    k->refs = 1;
+    k->len = 0;
+    return k;
+}
 
-        buffer[bytes_received] = '\0';
-        std::string command(buffer);
-        std::stringstream ss(command);
-        std::string action;
-        ss >> action;
+static void unref(Reactor &r, Chunk *k) {
+    if (--k->refs == 0) {
+        k->next_free = r.free_chunks;
+        r.free_chunks = k;
+    }
+}
 
-        bool update_needed = false;
+// Fills the 3-byte header in front of a payload already written at
+// data + 3 and sets the chunk length.
+static void seal_message(Chunk *k, int type, int n) {
+    k->data[0] = (uint8_t)type;
+    k->data[1] = (uint8_t)(n & 0xff);
+    k->data[2] = (uint8_t)(n >> 8);
+    k->len = (uint32_t)n + 3;
+}
 
-        {
-            std::lock_guard<std::mutex> lock(state_mutex);
-            if (action == "MOVE") {
-                int dh, dw; // dy, dx
-                ss >> dh >> dw; // Protocol: MOVE dy dx (h=row, w=col)
-                
-                Point& p = players[id];
-                int nr = p.r + dh;
-                int nc = p.c + dw;
-
-                if (nr >= 0 && nr <= BOARD_SIZE && nc >= 0 && nc <= BOARD_SIZE) {
-                    p.r = nr;
-                    p.c = nc;
-                    update_needed = true;
-                }
-            } else if (action == "PLACE") {
-                // Determine color based on ID/Order logic re-check or stored
-                // For this simple prototype, we'll assume the assigned color holds.
-                // In a real app we'd store color in a map.
-                
-                Point p = players[id];
-                // Check if empty
-                bool empty = true;
-                for (const auto& s : stones) {
-                    if (s.first.r == p.r && s.first.c == p.c) {
-                        empty = false;
-                        break;
-                    }
-                }
+// Sends what the socket takes now and queues a reference for the rest;
+// false if the client is too far behind to keep.
+static bool send_chunk(Reactor &r, Conn *c, Chunk *k) {
+    if (c->out_head == c->out_tail) {
+        ssize_t sent = send(c->fd, k->data, k->len, MSG_NOSIGNAL);
+        if (sent == (ssize_t)k->len)
+            return true;
+        if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            return false;
+        c->out_offset = sent > 0 ? (uint32_t)sent : 0;
+    }
+    if (c->out_tail - c->out_head == OUT_CHUNKS)
+        return false;
+    k->refs++;
+    c->out[c->out_tail++ & (OUT_CHUNKS - 1)] = k;
+    if (!c->want_write) {
+        c->want_write = true;
+        watch(r, c);
+    }
+    return true;
+}
 
-                if (empty) {
-                    stones.push_back({p, color});
-                    update_needed = true;
-                }
+// Writes queued chunks with one sendmsg per IOV_BATCH of them.
+static bool flush_out(Reactor &r, Conn *c) {
+    while (c->out_head != c->out_tail) {
+        iovec iov[IOV_BATCH];
+        int n = 0;
+        for (uint32_t i = c->out_head; i != c->out_tail && n < IOV_BATCH; i++, n++) {
+            Chunk *k = c->out[i & (OUT_CHUNKS - 1)];
+            uint32_t skip = n == 0 ? c->out_offset : 0;
+            iov[n].iov_base = k->data + skip;
+            iov[n].iov_len = k->len - skip;
+        }
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+        ssize_t sent = sendmsg(c->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        for (int i = 0; i < n && sent > 0; i++) {
+            if ((size_t)sent < iov[i].iov_len) {
+                c->out_offset += (uint32_t)sent;
+                break;
             }
+            sent -= (ssize_t)iov[i].iov_len;
+            unref(r, c->out[c->out_head++ & (OUT_CHUNKS - 1)]);
+            c->out_offset = 0;
         }
+    }
+    return true;
+}
 
-        if (update_needed) {
-            std::string msg;
-            std::vector<SOCKET> client_copy;
-            {
-                std::lock_guard<std::mutex> lock(state_mutex);
-                msg = serialize_state();
-                client_copy = all_clients; // Copy to avoid holding lock during I/O
-            }
-            broadcast(msg, client_copy);
+static void close_conn(Reactor &r, Conn *c);
+
+// Brings every local member of the room up to date. Members holding the
+// same version share one frame, serialised once.
+static void send_room_update(Reactor &r, long long room_id) {
+    auto it = r.members.find(room_id);
+    if (it == r.members.end())
+        return;
+    std::vector<Conn *> dead;
+    Chunk *frame = nullptr;
+    long long built_since = -2, built_version = -1;
+    for (Conn *c : it->second) {
+        if (c->version != built_since) {
+            if (frame)
+                unref(r, frame);
+            frame = new_chunk(r);
+            int n = get_state_frame(room_id, c->version, frame->data + 3, CHUNK_BYTES - 3, &built_version);
+            if (n > 0)
+                seal_message(frame, MSG_FRAME, n);
+            built_since = c->version;
         }
+        if (frame->len == 0 || built_version == c->version)
+            continue;
+        c->version = built_version;
+        if (!send_chunk(r, c, frame))
+            dead.push_back(c);
     }
+    if (frame)
+        unref(r, frame);
+    for (Conn *c : dead)
+        close_conn(r, c);
+}
 
-    // Cleanup
-    closesocket(client_socket);
+static void join_room_cmd(Reactor &r, Conn *c, long long room_id) {
+    if (c->room != -1 || room_id < 0)
+        return;
     {
-        std::lock_guard<std::mutex> lock(state_mutex);
-        players.erase(id);
-        std::cout << "Client " << id << " disconnected." << std::endl;
-        
-        // Remove from client list
-        for (auto it = all_clients.begin(); it != all_clients.end(); ) {
-            if (*it == client_socket) {
-                it = all_clients.erase(it);
-            } else {
-                ++it;
-            }
+        // Creating the room and counting the member happen under dir_mutex,
+        // so a leave_room emptying the same room cannot destroy it between.
+        std::lock_guard<std::mutex> lock(dir_mutex);
+        init_game(room_id);
+        int out_r, out_c;
+        move_player(room_id, c->player, 0, 0, &out_r, &out_c);
+        RoomDir &d = room_dir[room_id];
+        if (d.black == -1)
+            d.black = c->player, c->color = 1;
+        else if (d.white == -1)
+            d.white = c->player, c->color = 2;
+        d.members[r.id]++;
+        d.reactors |= 1ull << r.id;
+        d.total++;
+    }
+    c->room = room_id;
+    r.members[room_id].push_back(c);
+
+    Chunk *welcome = new_chunk(r);
+    uint8_t *p = put_varint(welcome->data + 3, (uint32_t)c->player);
+    *p++ = (uint8_t)c->color;
+    seal_message(welcome, MSG_WELCOME, (int)(p - welcome->data - 3));
+    send_chunk(r, c, welcome);
+    unref(r, welcome);
+    post_update(room_id);
+}
+
+static void leave_room(Reactor &r, Conn *c) {
+    if (c->room == -1)
+        return;
+    long long room_id = c->room;
+    std::vector<Conn *> &local = r.members[room_id];
+    local.erase(std::find(local.begin(), local.end(), c));
+    if (local.empty())
+        r.members.erase(room_id);
+    submit_room_command(room_id, ROOM_CMD_REMOVE, c->player, 0, 0, 0);
+
+    {
+        // The last member out destroys the room before a JOIN elsewhere can
+        // see it empty (see join_room_cmd).
+        std::lock_guard<std::mutex> lock(dir_mutex);
+        RoomDir &d = room_dir[room_id];
+        if (d.black == c->player)
+            d.black = -1;
+        if (d.white == c->player)
+            d.white = -1;
+        if (--d.members[r.id] == 0)
+            d.reactors &= ~(1ull << r.id);
+        if (--d.total == 0) {
+            room_dir.erase(room_id);
+            destroy_room(room_id);
         }
     }
+    c->room = -1;
 }
 
-int main() {
-    WSADATA wsaData;
-    WSAStartup(MAKEWORD(2, 2), &wsaData);
+static void close_conn(Reactor &r, Conn *c) {
+    leave_room(r, c);
+    while (c->out_head != c->out_tail)
+        unref(r, c->out[c->out_head++ & (OUT_CHUNKS - 1)]);
+    epoll_ctl(r.epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    delete c;
+}
 
-    SOCKET server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    server_addr.sin_addr.s_addr = INADDR_ANY;
+// Parses one line in place: a command word and up to two integers
+// separated by spaces or tabs. A trailing '\r' is ignored.
+static Command parse_command(const char *p, const char *end) {
+    Command cmd = {CMD_UNKNOWN, 0, {0, 0}};
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    const char *word = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    size_t len = (size_t)(p - word);
+    static const struct {
+        const char *name;
+        int op;
+    } words[] = {{"JOIN", CMD_JOIN}, {"MOVE", CMD_MOVE}, {"PLACE", CMD_PLACE}, {"RESET", CMD_RESET}, {"PING", CMD_PING}};
+    for (const auto &w : words)
+        if (strlen(w.name) == len && memcmp(w.name, word, len) == 0)
+            cmd.op = w.op;
 
-    bind(server_socket, (sockaddr*)&server_addr, sizeof(server_addr));
-    listen(server_socket, SOMAXCONN);
+    while (cmd.args < 2) {
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        bool neg = p < end && *p == '-';
+        if (neg)
+            p++;
+        if (p == end || *p < '0' || *p > '9')
+            break;
+        long long v = 0;
+        while (p < end && *p >= '0' && *p <= '9' && v < (1LL << 58))
+            v = v * 10 + (*p++ - '0');
+        cmd.arg[cmd.args++] = neg ? -v : v;
+    }
+    return cmd;
+}
 
-    std::vector<SOCKET> clients;
-    int client_id_counter = 0;
+// Runs one command; false drops the client.
+static bool handle_command(Reactor &r, Conn *c, const Command &cmd) {
+    long long a = cmd.arg[0], b = cmd.arg[1];
+    if (cmd.op == CMD_JOIN && cmd.args >= 1) {
+        join_room_cmd(r, c, a);
+    } else if (cmd.op == CMD_PING) {
+        Chunk *pong = new_chunk(r);
+        uint8_t *p = put_varint(pong->data + 3, (uint64_t)a);
+        seal_message(pong, MSG_PONG, (int)(p - pong->data - 3));
+        bool ok = send_chunk(r, c, pong);
+        unref(r, pong);
+        return ok;
+    } else if (c->room == -1) {
+        return true;
+    } else if (cmd.op == CMD_MOVE && cmd.args == 2) {
+        submit_room_command(c->room, ROOM_CMD_MOVE, c->player, (int)b, (int)a, 0);
+    } else if (cmd.op == CMD_PLACE && c->color != 0) {
+        int pr = cmd.args == 2 ? (int)a : -1, pc = (int)b;
+        submit_room_command(c->room, ROOM_CMD_PLACE, c->player, pr, pc, c->color);
+    } else if (cmd.op == CMD_RESET) {
+        submit_room_command(c->room, ROOM_CMD_RESET, c->player, 0, 0, 0);
+    }
+    return true;
+}
 
-    std::cout << "Server listening on port " << PORT << std::endl;
+// Reads what arrived and runs every complete line straight out of the
+// connection's input buffer; a partial line is kept for the next read.
+// False drops the client.
+static bool on_readable(Reactor &r, Conn *c) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, IN_BUF - c->in_len, 0);
+        if (n == 0)
+            return false;
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        c->in_len += (uint32_t)n;
 
-    while (true) {
-        SOCKET client_socket = accept(server_socket, NULL, NULL);
-        if (client_socket == INVALID_SOCKET) continue;
+        const char *line = (const char *)c->in;
+        const char *end = line + c->in_len;
+        const char *from = line + c->in_scanned;
+        const char *nl;
+        while ((nl = (const char *)memchr(from, '\n', (size_t)(end - from)))) {
+            if (!handle_command(r, c, parse_command(line, nl)))
+                return false;
+            line = from = nl + 1;
+        }
+        uint32_t rest = (uint32_t)(end - line);
+        if (rest > MAX_LINE)
+            return false;
+        memmove(c->in, line, rest);
+        c->in_len = c->in_scanned = rest;
+    }
+}
 
-        {
-            std::lock_guard<std::mutex> lock(state_mutex);
-            clients.push_back(client_socket);
+static void accept_all(Reactor &r) {
+    for (;;) {
+        int fd = accept4(r.listen_fd, nullptr, nullptr, SOCK_NONBLOCK);
+        if (fd < 0)
+            return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Conn *c = new Conn();
+        c->fd = fd;
+        c->reactor = r.id;
+        c->player = next_player_id.fetch_add(1);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.ptr = c;
+        epoll_ctl(r.epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void drain_inbox(Reactor &r) {
+    std::vector<long long> &rooms = r.inbox_spare;
+    {
+        std::lock_guard<std::mutex> lock(r.inbox_mutex);
+        rooms.swap(r.inbox);
+    }
+    std::sort(rooms.begin(), rooms.end());
+    rooms.erase(std::unique(rooms.begin(), rooms.end()), rooms.end());
+    for (long long room_id : rooms)
+        send_room_update(r, room_id);
+    rooms.clear();
+}
+
+static void run_reactor(Reactor &r) {
+    epoll_event events[256];
+    for (;;) {
+        int n = epoll_wait(r.epfd, events, 256, -1);
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listen_tag) {
+                accept_all(r);
+            } else if (tag == &wake_tag) {
+                uint64_t count;
+                (void)!read(r.wake_fd, &count, sizeof(count));
+            } else {
+                Conn *c = (Conn *)tag;
+                uint32_t ev = events[i].events;
+                bool ok = !(ev & (EPOLLERR | EPOLLHUP));
+                if (ok && (ev & EPOLLIN))
+                    ok = on_readable(r, c);
+                if (ok && (ev & EPOLLRDHUP))
+                    ok = false;
+                if (ok && (ev & EPOLLOUT)) {
+                    ok = flush_out(r, c);
+                    if (ok && c->out_head == c->out_tail) {
+                        c->want_write = false;
+                        watch(r, c);
+                    }
+                }
+                if (!ok)
+                    close_conn(r, c);
+            }
         }
+        drain_inbox(r);
+    }
+}
+
+static int open_listener(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    return fd;
+}
+
+// Hands each room that changed on its shard to the reactors of its members.
+static void run_ticker() {
+    long long ids[1024];
+    for (;;) {
+        int n = next_tick(ids, 1024);
+        for (int i = 0; i < n; i++)
+            post_update(ids[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    int port = argc > 1 ? atoi(argv[1]) : PORT;
+    reactor_count = argc > 2 ? std::max(1, std::min(atoi(argv[2]), MAX_REACTORS))
+                             : std::max(1, std::min((int)std::thread::hardware_concurrency(), MAX_REACTORS));
+    int shards = argc > 3 ? atoi(argv[3]) : (int)std::thread::hardware_concurrency();
+    signal(SIGPIPE, SIG_IGN);
+    set_tick_hz(TICK_HZ);
+    shards = set_room_shards(shards);
 
-        std::thread(handle_client, client_socket, ++client_id_counter, std::ref(clients)).detach();
+    for (int i = 0; i < reactor_count; i++) {
+        Reactor &r = reactors[i];
+        r.id = i;
+        r.epfd = epoll_create1(0);
+        r.listen_fd = open_listener(port);
+        r.wake_fd = eventfd(0, EFD_NONBLOCK);
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = &listen_tag;
+        epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.listen_fd, &ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = &wake_tag;
+        epoll_ctl(r.epfd, EPOLL_CTL_ADD, r.wake_fd, &ev);
     }
+    for (int i = 0; i < reactor_count; i++)
+        reactors[i].thread = std::thread(run_reactor, std::ref(reactors[i]));
+    std::thread ticker(run_ticker);
 
-    WSACleanup();
+    printf("Server listening on port %d with %d reactors, %d room shards\n", port, reactor_count, shards);
+    ticker.join();
     return 0;
 }
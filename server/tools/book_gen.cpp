@@ -0,0 +1,180 @@
+// 컴파일 : g++ -O2 -std=c++17 -pthread book_gen.cpp -o book_gen
+// 실행 : ./book_gen <out.book> [games] [plies] [budget_ms] [threads] [in.book]
+//
+// Builds an opening book (see "Opening book" in game_logic.cpp) from
+// self-play. Each game opens at the centre with one or two random replies
+// near it for variety, then the engine plays both sides with budget_ms per
+// move. Every engine move among the first `plies` stones is counted under
+// its symmetry-normalised key: 2 if the side that played it went on to win,
+// 1 for a draw. Moves that only ever lost are left out. With in.book the
+// counts are added to that book's, so a book can be extended run by run.
+#include "../game_logic.cpp"
+#include <cstdio>
+#include <map>
+#include <random>
+
+#define GEN_ROOM_BASE 7000000000LL
+#define GAME_MAX_PLIES 160
+
+typedef std::map<std::pair<uint64_t, int>, uint32_t> BookCounts;
+
+struct GenMove
+{
+    uint64_t key;
+    int move; // normalised
+    int player;
+};
+
+static bool read_book(const char *path, BookCounts &counts)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    BookHeader head;
+    bool ok = fread(&head, sizeof(head), 1, f) == 1 && memcmp(head.magic, BOOK_MAGIC, sizeof(head.magic)) == 0;
+    BookEntry e;
+    for (uint64_t i = 0; ok && i < head.count && fread(&e, sizeof(e), 1, f) == 1; i++)
+        counts[{e.key, e.move}] += e.weight;
+    fclose(f);
+    return ok;
+}
+
+// Returns the number of entries written, or -1.
+static long long write_book(const char *path, const BookCounts &counts)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return -1;
+    BookHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, BOOK_MAGIC, sizeof(head.magic));
+    for (const auto &kv : counts)
+        head.count += kv.second > 0;
+    fwrite(&head, sizeof(head), 1, f);
+    // std::map iterates in (key, move) order, which is the order lookups need.
+    for (const auto &kv : counts)
+    {
+        if (kv.second == 0)
+            continue;
+        BookEntry e = {kv.first.first, (uint16_t)kv.first.second, 0, kv.second};
+        fwrite(&e, sizeof(e), 1, f);
+    }
+    return fclose(f) == 0 ? (long long)head.count : -1;
+}
+
+// Plays one game in room_id; appends the engine's book moves to out and
+// returns the winner (1, -1) or 0 for a draw.
+static int play_game(long long room_id, std::mt19937 &rng, int plies, int budget_us, std::vector<GenMove> &out)
+{
+    init_game(room_id);
+    reset_game(room_id);
+    AI_Board b;
+    b.clear();
+    int random_plies = 2 + (int)(rng() % 2);
+    int p = 1;
+    for (int ply = 0; ply < GAME_MAX_PLIES; ply++, p = -p)
+    {
+        int m;
+        bool engine = ply >= random_plies;
+        if (ply == 0)
+            m = 7 * BOARD_SIZE + 7;
+        else if (!engine)
+        {
+            do
+                m = (5 + (int)(rng() % 5)) * BOARD_SIZE + 5 + (int)(rng() % 5);
+            while (b.at(m) != 0);
+        }
+        else
+        {
+            int r, c, depth;
+            long long nodes;
+            get_ai_move_timed(room_id, p == 1 ? 1 : 2, budget_us, &r, &c, &depth, &nodes);
+            m = r * BOARD_SIZE + c;
+        }
+        if (engine && ply < plies)
+        {
+            int sym;
+            uint64_t key = book_key(b, p, &sym);
+            out.push_back({key, book_sym(sym, m), p});
+        }
+        if (!place_stone(room_id, m / BOARD_SIZE, m % BOARD_SIZE, p == 1 ? 1 : 2))
+            return 0;
+        b.play(m, p);
+        if (b.win_at(m))
+            return p;
+    }
+    return 0;
+}
+
+struct GenShared
+{
+    std::mutex mutex;
+    BookCounts counts;
+    int games_left;
+    int wins[3] = {0, 0, 0}; // white, draw, black
+};
+
+static void gen_worker(int id, int plies, int budget_us, GenShared *shared)
+{
+    std::mt19937 rng(977 * id + 1);
+    long long room_id = GEN_ROOM_BASE + id;
+    std::vector<GenMove> moves;
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (shared->games_left == 0)
+                break;
+            shared->games_left--;
+        }
+        moves.clear();
+        int winner = play_game(room_id, rng, plies, budget_us, moves);
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->wins[winner + 1]++;
+        for (const GenMove &g : moves)
+            shared->counts[{g.key, g.move}] += winner == 0 ? 1 : (winner == g.player ? 2 : 0);
+        int done = shared->wins[0] + shared->wins[1] + shared->wins[2];
+        printf("\rgames %d  black %d  white %d  draws %d", done, shared->wins[2], shared->wins[0], shared->wins[1]);
+        fflush(stdout);
+    }
+    destroy_room(room_id);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("usage: %s <out.book> [games] [plies] [budget_ms] [threads] [in.book]\n", argv[0]);
+        return 1;
+    }
+    int games = argc > 2 ? std::max(1, atoi(argv[2])) : 100;
+    int plies = argc > 3 ? std::max(1, std::min(atoi(argv[3]), BOOK_MAX_STONES + 1)) : BOOK_MAX_STONES + 1;
+    int budget_ms = argc > 4 ? std::max(1, atoi(argv[4])) : 200;
+    int threads = argc > 5 ? std::max(1, atoi(argv[5])) : std::max(1u, std::thread::hardware_concurrency());
+
+    GenShared shared;
+    shared.games_left = games;
+    if (argc > 6 && !read_book(argv[6], shared.counts))
+    {
+        printf("cannot read %s\n", argv[6]);
+        return 1;
+    }
+    size_t before = shared.counts.size();
+    set_ai_threads(1); // parallel games instead of parallel search
+    load_opening_book(""); // the engine's own choices, not the old book's
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(gen_worker, i, plies, budget_ms * 1000, &shared);
+    for (std::thread &t : workers)
+        t.join();
+
+    long long written = write_book(argv[1], shared.counts);
+    if (written < 0)
+    {
+        printf("\ncannot write %s\n", argv[1]);
+        return 1;
+    }
+    printf("\n%lld entries (%zu new moves seen) written to %s\n", written, shared.counts.size() - before, argv[1]);
+    return 0;
+}
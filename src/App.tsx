@@ -14,6 +14,65 @@ interface Stone {
   color: 'black' | 'white';
 }
 
+// Room state frame packed by the server (see "Wire frames" in game_logic.cpp).
+const FRAME_FORMAT = 1;
+const FRAME_FULL = 1;
+const FRAME_GONE = 255;
+
+interface RoomFrame {
+  full: boolean;
+  turn: number; // 1=black, 2=white
+  version: number;
+  base: number; // version a delta applies to
+  players: [number, number, number][]; // id, r, c (FRAME_GONE if removed)
+  cells: number[]; // r * size + c; colours alternate from black
+}
+
+// null for a frame of another format, 'short' for one that ends early or
+// whose varints and counts run past its end.
+function readFrame(buf: ArrayBuffer): RoomFrame | 'short' | null {
+  const view = new DataView(buf);
+  let off = 0;
+  let short = false;
+  const u8 = () => {
+    if (off >= view.byteLength) {
+      short = true;
+      return 0;
+    }
+    return view.getUint8(off++);
+  };
+  const varint = () => {
+    let v = 0, mul = 1, b: number;
+    do {
+      b = u8();
+      v += (b & 0x7f) * mul;
+      mul *= 128;
+    } while (b & 0x80 && mul < 2 ** 56);
+    if (b & 0x80) short = true; // longer than any u64
+    return v;
+  };
+
+  if (view.byteLength < 3) return 'short';
+  if (u8() !== FRAME_FORMAT) return null;
+  const full = (u8() & FRAME_FULL) !== 0;
+  const turn = u8();
+  const version = varint();
+  const base = full ? -1 : varint();
+  const players: [number, number, number][] = [];
+  let n = varint();
+  if (short || n * 3 > view.byteLength - off) return 'short'; // 3+ bytes each
+  for (; n > 0 && !short; n--) {
+    const id = varint();
+    const r = u8();
+    players.push([id, r, u8()]);
+  }
+  const cells: number[] = [];
+  n = varint();
+  if (short || n > view.byteLength - off) return 'short'; // 1+ byte each
+  for (; n > 0 && !short; n--) cells.push(varint());
+  return short ? 'short' : { full, turn, version, base, players, cells };
+}
+
 export default function App() {
   const BOARD_SIZE = 15;
 
@@ -30,6 +89,8 @@ export default function App() {
 
   const socketRef = useRef<Socket | null>(null);
   const posRef = useRef<[number, number]>([Math.floor(BOARD_SIZE / 2), Math.floor(BOARD_SIZE / 2)]);
+  const versionRef = useRef<number | null>(null); // room state version we hold
+  const sidByIdRef = useRef<Map<number, string>>(new Map()); // player id -> member sid
 
   useEffect(() => {
     const socket = io('http://localhost:5000');
@@ -42,6 +103,7 @@ export default function App() {
       setPlayers({});
       setMembers([]);
       setBoard([]);
+      versionRef.current = null;
     });
 
     socket.on('connection_response', (payload: { id?: string }) => {
@@ -51,21 +113,76 @@ export default function App() {
     socket.on('joined', () => setJoined(true));
     socket.on('join_error', (p: { reason?: string }) => alert('방 참여 실패: ' + (p?.reason || 'unknown')));
 
-    socket.on('room_state', (payload: { data?: PlayerData; members?: string[], board?: Stone[], can_place_color?: number }) => {
-      if (!payload) return;
-      setPlayers(payload.data || {});
-      setMembers(payload.members || []);
-      setBoard(payload.board || []);
-      setCanPlaceColor((payload as any).can_place_color ?? null);
-
+    const trackMyPos = (data?: PlayerData) => {
       // We need to use the state from the argument because of the closure
       setMyId(myId => {
-        const myData = payload.data ? payload.data[myId!] : null;
+        const myData = data ? data[myId!] : null;
         if (myData && myData[0]) {
           posRef.current = myData[0];
         }
         return myId;
       });
+    };
+
+    const toStones = (cells: number[], first: number): Stone[] =>
+      cells.map((cell, i) => ({
+        r: Math.floor(cell / BOARD_SIZE),
+        c: cell % BOARD_SIZE,
+        color: (first + i) % 2 === 0 ? 'black' : 'white',
+      }));
+
+    socket.on('room_members', (payload: { members?: string[]; ids?: { [sid: string]: number } }) => {
+      if (!payload) return;
+      const present = payload.members || [];
+      sidByIdRef.current = new Map(Object.entries(payload.ids || {}).map(([sid, id]): [number, string] => [id, sid]));
+      setMembers(present);
+      setPlayers(prev => {
+        const next: PlayerData = {};
+        for (const id of present) {
+          if (prev[id]) next[id] = prev[id];
+        }
+        return next;
+      });
+    });
+
+    socket.on('room_frame', (buf: ArrayBuffer) => {
+      const frame = buf ? readFrame(buf) : null;
+      if (frame === 'short') {
+        // Cut or corrupted: drop what we hold and ask for a full snapshot.
+        versionRef.current = null;
+        socket.emit('sync');
+        return;
+      }
+      if (!frame) return;
+      const held = versionRef.current;
+      if (!frame.full) {
+        if (held === null || frame.version <= held) return;
+        if (frame.base !== held) {
+          // Missed an update: ask for a full snapshot.
+          versionRef.current = null;
+          socket.emit('sync');
+          return;
+        }
+      }
+      versionRef.current = frame.version;
+
+      const changed: PlayerData = {};
+      const gone: string[] = [];
+      for (const [id, r, c] of frame.players) {
+        const sid = sidByIdRef.current.get(id);
+        if (!sid) continue;
+        if (r === FRAME_GONE) gone.push(sid);
+        else changed[sid] = [[r, c]];
+      }
+      setPlayers(prev => {
+        const next: PlayerData = frame.full ? changed : { ...prev, ...changed };
+        for (const sid of gone) delete next[sid];
+        return next;
+      });
+      if (frame.full) setBoard(toStones(frame.cells, 0));
+      else if (frame.cells.length > 0) setBoard(prev => [...prev, ...toStones(frame.cells, prev.length)]);
+      setCanPlaceColor(frame.turn === 1 || frame.turn === 2 ? frame.turn : null);
+      trackMyPos(changed);
     });
 
     return () => {